@@ -0,0 +1,188 @@
+#include "annealing.hpp"
+#include "random.hpp"
+#include "stochastic.hpp"
+#include "work_pool.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+/** Chain of the parallel tempering */
+template <unsigned K> struct Replica {
+  SharpeCache<K> cache;
+  sharpe_t sharpe;
+  MoveProposals proposals;
+
+  /** Best composition of the replica, only saved once the replica moves
+   * away from it */
+  finmath::FixedComposition<K> best_compo;
+  sharpe_t best_sharpe;
+  bool at_best;
+};
+
+/** Acceptance counters of a temperature of the ladder */
+struct TemperatureStats {
+  unsigned long long nb_moves = 0;
+  unsigned long long nb_accepted = 0;
+
+  /** Exchanges with the next temperature */
+  unsigned long long nb_exchanges = 0;
+  unsigned long long nb_exchanged = 0;
+};
+
+/** Factor of the start temperatures at `progress` in [0, 1] of the run */
+static double schedule_factor(const AnnealingParams &params,
+                              double progress) {
+  switch (params.schedule) {
+  case AnnealingSchedule::constant:
+    return 1;
+  case AnnealingSchedule::linear:
+    return 1 - progress * (1 - params.final_ratio);
+  case AnnealingSchedule::geometric:
+    return std::pow(params.final_ratio, progress);
+  }
+  return 1;
+}
+
+/** Try `nb_steps` moves of the replica at the given temperature */
+template <unsigned K>
+static void run_replica(Replica<K> &replica, double temperature,
+                        unsigned nb_steps, TemperatureStats &stats) {
+  auto &cache = replica.cache;
+
+  for (auto _i = 0u; _i < nb_steps; ++_i) {
+    auto move = random_move(cache, replica.proposals);
+    if (!move)
+      continue;
+
+    // Metropolis criterion, the infeasible compositions are always rejected
+    ++stats.nb_moves;
+    auto sharpe = *move;
+    auto accepted =
+        sharpe != -INFINITY &&
+        (sharpe >= replica.sharpe ||
+         uniform_unit(replica.proposals.gen) <
+             std::exp((sharpe - replica.sharpe) / temperature));
+    if (!accepted) {
+      undo_change(cache);
+      continue;
+    }
+
+    ++stats.nb_accepted;
+    replica.sharpe = sharpe;
+    if (sharpe > replica.best_sharpe) {
+      replica.best_sharpe = sharpe;
+      replica.at_best = true;
+    } else if (replica.at_best) {
+      replica.best_compo = compo_before_change(cache);
+      replica.at_best = false;
+    }
+  }
+}
+
+template <unsigned K>
+static TopCompos anneal_compo(const TrucsInteressants &trucs,
+                              const compo_t &start_compo,
+                              const AnnealingParams &params,
+                              unsigned nb_results) {
+  auto nb_levels = std::max(1u, params.nb_replicas);
+  auto start = finmath::FixedComposition<K>(start_compo, trucs.start_values);
+
+  auto replicas = std::vector<Replica<K>>();
+  replicas.reserve(nb_levels);
+  for (auto i = 0u; i < nb_levels; ++i) {
+    auto cache = SharpeCache<K>(trucs);
+    auto sharpe = compute_sharpe_init_chache(start, cache);
+    if (!check_compo_cache(cache)) {
+      sharpe = -INFINITY;
+    }
+    replicas.push_back(Replica<K>{cache, sharpe, MoveProposals(random_seed()),
+                                  start, sharpe, true});
+  }
+
+  // Ladder of temperatures, in the scale of the start sharpe
+  auto scale = std::isfinite(replicas[0].sharpe) && replicas[0].sharpe != 0
+                   ? std::abs(replicas[0].sharpe)
+                   : 1.0;
+  auto temperatures = std::vector<double>(nb_levels);
+  for (auto level = 0u; level < nb_levels; ++level) {
+    auto position = nb_levels == 1 ? 0.0 : double(level) / (nb_levels - 1);
+    temperatures[level] =
+        scale * params.min_temperature *
+        std::pow(params.max_temperature / params.min_temperature, position);
+  }
+
+  // Replica at each temperature, exchanged instead of the compositions
+  auto replica_at = std::vector<unsigned>(nb_levels);
+  std::iota(replica_at.begin(), replica_at.end(), 0);
+  auto stats = std::vector<TemperatureStats>(nb_levels);
+
+  auto pool = WorkStealingPool<unsigned>();
+  std::clog << "Annealing of " << nb_levels << " replicas on "
+            << pool.nb_workers() << " threads\n";
+
+  auto gen = Xoshiro256pp(random_seed());
+  auto period = std::max(1u, params.exchange_period);
+  auto nb_rounds = (params.nb_steps + period - 1) / period;
+  for (auto round = 0ull; round < nb_rounds; ++round) {
+    auto factor = schedule_factor(params, double(round) / nb_rounds);
+
+    auto levels = std::vector<unsigned>(nb_levels);
+    std::iota(levels.begin(), levels.end(), 0);
+    pool.run(std::move(levels), [&](unsigned &&level, unsigned) {
+      run_replica(replicas[replica_at[level]], factor * temperatures[level],
+                  period, stats[level]);
+    });
+
+    // Exchange the replicas of neighbouring temperatures, alternating the
+    // even and odd pairs
+    for (auto level = round % 2; level + 1 < nb_levels; level += 2) {
+      auto cold_beta = 1 / (factor * temperatures[level]);
+      auto hot_beta = 1 / (factor * temperatures[level + 1]);
+      auto cold_sharpe = replicas[replica_at[level]].sharpe;
+      auto hot_sharpe = replicas[replica_at[level + 1]].sharpe;
+
+      auto log_ratio = (cold_beta - hot_beta) * (hot_sharpe - cold_sharpe);
+      ++stats[level].nb_exchanges;
+      if (log_ratio >= 0 || uniform_unit(gen) < std::exp(log_ratio)) {
+        std::swap(replica_at[level], replica_at[level + 1]);
+        ++stats[level].nb_exchanged;
+      }
+    }
+  }
+
+  if (params.log_acceptance) {
+    for (auto level = 0u; level < nb_levels; ++level) {
+      const auto &level_stats = stats[level];
+      std::clog << "- T=" << temperatures[level] << ": moves accepted "
+                << 100.0 * level_stats.nb_accepted /
+                       std::max(1ull, level_stats.nb_moves)
+                << "%";
+      if (level + 1 < nb_levels) {
+        std::clog << " | exchanges with the next one "
+                  << 100.0 * level_stats.nb_exchanged /
+                         std::max(1ull, level_stats.nb_exchanges)
+                  << "%";
+      }
+      std::clog << '\n';
+    }
+  }
+
+  auto results = TopCompos(nb_results);
+  for (const auto &replica : replicas) {
+    if (replica.best_sharpe != -INFINITY) {
+      const auto &best_compo =
+          replica.at_best ? replica.cache.compo : replica.best_compo;
+      results.push(replica.best_sharpe, best_compo.investments());
+    }
+  }
+  return results;
+}
+
+TopCompos anneal_compo(const TrucsInteressants &trucs,
+                       const compo_t &start_compo,
+                       const AnnealingParams &params, unsigned nb_results) {
+  return dispatch_portfolio_size(start_compo.size(), [&]<unsigned K>() {
+    return anneal_compo<K>(trucs, start_compo, params, nb_results);
+  });
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "tree.hpp"
+
+/** How the temperatures of the annealing evolve during the run */
+enum class AnnealingSchedule {
+  /** Fixed temperatures: parallel tempering only */
+  constant,
+  /** Temperatures decreasing linearly down to `final_ratio` of their start */
+  linear,
+  /** Temperatures decreasing geometrically down to `final_ratio` of their
+   * start */
+  geometric,
+};
+
+struct AnnealingParams {
+  /** Number of replicas, each one at its own temperature */
+  unsigned nb_replicas = 8;
+
+  /** Number of moves tried by each replica */
+  unsigned long long nb_steps = 1000000;
+
+  /** Number of moves of the replicas between two exchanges */
+  unsigned exchange_period = 5000;
+
+  /** Temperatures of the coldest and hottest replicas, relative to the
+   * sharpe of the start composition. The others are spread geometrically
+   * between them. */
+  double min_temperature = 1e-4;
+  double max_temperature = 1e-1;
+
+  AnnealingSchedule schedule = AnnealingSchedule::geometric;
+  double final_ratio = 1e-2;
+
+  /** Log the acceptance rates of the moves and exchanges per temperature */
+  bool log_acceptance = false;
+};
+
+/** Optimize a composition with a parallel tempering of simulated annealing
+ * chains: each replica accepts the moves that lower the sharpe with a
+ * probability depending on its temperature, and the replicas of neighbouring
+ * temperatures periodically exchange their compositions. The replicas run on
+ * every thread.
+ * \return the `nb_results` best compositions found by the replicas
+ */
+TopCompos anneal_compo(const TrucsInteressants &trucs,
+                       const compo_t &start_compo,
+                       const AnnealingParams &params, unsigned nb_results);
@@ -0,0 +1,216 @@
+#include "beam.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+/** Partial composition kept by the beam search */
+template <unsigned K> struct BeamState {
+  /** Increasing positions of the assets in `assets_by_capital` */
+  std::array<unsigned, K> positions;
+  unsigned nb_positions = 0;
+
+  /** Partial sums of the assets, with the cross terms of the positions after
+   * the last one */
+  TreeDepth depth;
+};
+
+/** A beam state followed by the asset at `pos` */
+struct BeamExtension {
+  sharpe_t sharpe;
+  unsigned i_state;
+  unsigned pos;
+};
+
+/** Keep only the `width` extensions with the best sharpes */
+static void keep_best(std::vector<BeamExtension> &extensions, unsigned width) {
+  if (extensions.size() <= width)
+    return;
+
+  std::nth_element(extensions.begin(), extensions.begin() + width,
+                   extensions.end(), [](const auto &a, const auto &b) {
+                     return a.sharpe > b.sharpe;
+                   });
+  extensions.resize(width);
+}
+
+/** Number of shares of the asset at `pos` when the first asset of the
+ * composition is at `first_pos`, like `fill_compo` */
+static nb_shares_t beam_nb_shares(const TrucsInteressants &trucs,
+                                  const std::vector<share_index_t> &order,
+                                  unsigned first_pos, unsigned pos) {
+  auto min_cap = trucs.assets_capital[order[first_pos]];
+  auto max_cap = (max_share_percent / min_share_percent) * min_cap;
+  return max_cap / trucs.start_values[order[pos]];
+}
+
+/** Compute the partial sums of the state followed by the asset at `pos`, in
+ * O(1) from the sums of the state */
+template <unsigned K>
+static finmath::PortfolioSums
+extended_sums(const TrucsInteressants &trucs,
+              const std::vector<share_index_t> &order,
+              const BeamState<K> &state, unsigned pos) {
+  auto asset = order[pos];
+  auto first_pos = state.nb_positions == 0 ? pos : state.positions[0];
+  auto nb_shares = beam_nb_shares(trucs, order, first_pos, pos);
+  auto buy_value = nb_shares * trucs.start_values[asset];
+
+  auto sums = state.depth.sums;
+  sums.start_capital += buy_value;
+  sums.end_capital += nb_shares * trucs.end_values[asset];
+  sums.variance +=
+      buy_value * (buy_value * trucs.cov_matrix(asset, asset) +
+                   2 * state.depth.cross[pos]);
+  return sums;
+}
+
+/** Build the state followed by the asset at `pos` */
+template <unsigned K>
+static BeamState<K> extend_state(const TrucsInteressants &trucs,
+                                 const std::vector<share_index_t> &order,
+                                 const BeamState<K> &state, unsigned pos) {
+  auto asset = order[pos];
+  auto cov_vec = trucs.cov_matrix.row(asset);
+  auto first_pos = state.nb_positions == 0 ? pos : state.positions[0];
+  auto buy_value = beam_nb_shares(trucs, order, first_pos, pos) *
+                   trucs.start_values[asset];
+
+  auto next = BeamState<K>();
+  next.positions = state.positions;
+  next.positions[state.nb_positions] = pos;
+  next.nb_positions = state.nb_positions + 1;
+  next.depth.sums = extended_sums(trucs, order, state, pos);
+
+  // Only the positions after `pos` can still be added
+  next.depth.cross.resize(order.size());
+  for (auto pos2 = pos + 1; pos2 < order.size(); ++pos2) {
+    next.depth.cross[pos2] =
+        state.depth.cross[pos2] + buy_value * cov_vec[order[pos2]];
+  }
+  return next;
+}
+
+/** Indices of `size` tasks */
+static std::vector<unsigned> task_indices(std::size_t size) {
+  auto indices = std::vector<unsigned>(size);
+  std::iota(indices.begin(), indices.end(), 0);
+  return indices;
+}
+
+unsigned max_beam_width(std::size_t nb_assets) {
+  // Bound the size of the states of every portfolio size
+  auto state_bytes = sizeof(BeamState<max_portfolio_size>) +
+                     nb_assets * sizeof(double) + sizeof(BeamExtension);
+  auto width = max_beam_memory / (2 * state_bytes);
+  return (unsigned)std::clamp<std::size_t>(
+      width, 1, std::numeric_limits<unsigned>::max());
+}
+
+template <unsigned K>
+static TopCompos max_compo_beam(const TrucsInteressants &trucs,
+                                unsigned beam_width, unsigned nb_results) {
+  auto order = assets_by_capital(trucs);
+  auto nb_assets = (unsigned)order.size();
+  auto results = TopCompos(nb_results);
+  if (nb_assets < K)
+    return results;
+
+  // Keep enough complete compositions for the results
+  auto width = std::max(beam_width, nb_results);
+  auto pool = WorkStealingPool<unsigned>();
+  std::clog << "Beam search of " << K << " assets with a width of " << width
+            << " on " << pool.nb_workers() << " threads\n";
+
+  auto states = std::vector<BeamState<K>>(1);
+  states[0].depth.cross.assign(nb_assets, 0);
+  auto extensions = std::vector<BeamExtension>();
+  auto nb_scored = std::atomic<unsigned long long>(0);
+
+  for (auto size = 0u; size < K; ++size) {
+    // Score every extension of every state, each worker keeping its best ones
+    auto last = nb_assets - K + size + 1;
+    auto worker_extensions =
+        std::vector<std::vector<BeamExtension>>(pool.nb_workers());
+    pool.run(task_indices(states.size()), [&](unsigned &&i_state,
+                                              unsigned i_worker) {
+      const auto &state = states[i_state];
+      auto first = size == 0 ? 0 : state.positions[size - 1] + 1;
+      auto &kept = worker_extensions[i_worker];
+      nb_scored += last - first;
+      for (auto pos = first; pos < last; ++pos) {
+        auto sums = extended_sums(trucs, order, state, pos);
+        kept.push_back(BeamExtension{finmath::sharpe(sums), i_state, pos});
+      }
+      if (kept.size() >= 2 * width) {
+        keep_best(kept, width);
+      }
+    });
+
+    extensions.clear();
+    for (const auto &kept : worker_extensions) {
+      extensions.insert(extensions.end(), kept.begin(), kept.end());
+    }
+    keep_best(extensions, width);
+
+    if (size + 1 == K)
+      break;
+
+    // Build the partial sums of the kept extensions
+    auto next_states = std::vector<BeamState<K>>(extensions.size());
+    pool.run(task_indices(extensions.size()), [&](unsigned &&i, unsigned) {
+      const auto &extension = extensions[i];
+      next_states[i] = extend_state(trucs, order, states[extension.i_state],
+                                    extension.pos);
+    });
+    states = std::move(next_states);
+  }
+
+  // The extensions of the last step are complete compositions
+  auto compo = finmath::FixedComposition<K>();
+  for (const auto &extension : extensions) {
+    const auto &state = states[extension.i_state];
+    for (auto i = 0u; i < K - 1; ++i) {
+      compo.set_asset(i, order[state.positions[i]], 0, 0);
+    }
+    compo.set_asset(K - 1, order[extension.pos], 0, 0);
+
+    auto sharpe = fill_compo(trucs, compo);
+    results.push(sharpe, compo.investments());
+  }
+
+  std::clog << "Scored extensions: " << nb_scored << '\n';
+  return results;
+}
+
+template <unsigned K>
+static finmath::PortfolioSums
+beam_leaf_sums(const TrucsInteressants &trucs,
+               const std::vector<share_index_t> &order,
+               std::span<const unsigned> positions) {
+  auto state = BeamState<K>();
+  state.depth.cross.assign(order.size(), 0);
+  for (auto i = 0u; i + 1 < K; ++i) {
+    state = extend_state(trucs, order, state, positions[i]);
+  }
+  return extended_sums(trucs, order, state, positions[K - 1]);
+}
+
+finmath::PortfolioSums beam_leaf_sums(const TrucsInteressants &trucs,
+                                      const std::vector<share_index_t> &order,
+                                      std::span<const unsigned> positions) {
+  return dispatch_portfolio_size(positions.size(), [&]<unsigned K>() {
+    return beam_leaf_sums<K>(trucs, order, positions);
+  });
+}
+
+TopCompos max_compo_beam(const TrucsInteressants &trucs,
+                         unsigned portfolio_size, unsigned beam_width,
+                         unsigned nb_results) {
+  return dispatch_portfolio_size(portfolio_size, [&]<unsigned K>() {
+    return max_compo_beam<K>(trucs, beam_width, nb_results);
+  });
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "top_compos.hpp"
+#include "tree.hpp"
+
+/** Default number of partial compositions kept at each step of the beam
+ * search */
+constexpr unsigned default_beam_width = 256;
+
+/** Memory allowed for the partial compositions of the beam search, in bytes */
+constexpr std::size_t max_beam_memory = std::size_t(4) << 30;
+
+/** Largest beam width whose partial compositions fit in `max_beam_memory`
+ * with `nb_assets` assets. Each partial composition holds a double per asset,
+ * and the compositions of two steps are alive while they are extended.
+ */
+unsigned max_beam_width(std::size_t nb_assets);
+
+/** Find good compositions of `portfolio_size` assets with a beam search.
+ * The compositions are built one asset at a time, taking the assets in the
+ * order of `assets_by_capital` so that the first asset sizes every other one
+ * like `fill_compo`. At each step, every extension of the partial
+ * compositions is scored from their partial sums, and only the `beam_width`
+ * best ones are kept for the next step.
+ */
+TopCompos max_compo_beam(const TrucsInteressants &trucs,
+                         unsigned portfolio_size, unsigned beam_width,
+                         unsigned nb_results);
+
+/** Sums of the composition of the increasing `positions` in the `order` of
+ * `assets_by_capital`, built from the partial sums like the beam search, to
+ * check them against the reference */
+finmath::PortfolioSums beam_leaf_sums(const TrucsInteressants &trucs,
+                                      const std::vector<share_index_t> &order,
+                                      std::span<const unsigned> positions);
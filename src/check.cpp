@@ -1,7 +1,14 @@
 #include "check.hpp"
+#include "beam.hpp"
+#include "combinadic.hpp"
+#include "qp.hpp"
+#include "quadform.hpp"
+#include "stochastic.hpp"
 
 #include <iomanip>
 #include <iostream>
+#include <numeric>
+#include <random>
 
 bool check_compo(const TrucsInteressants &trucs, const compo_t &compo,
                  bool verbose) {
@@ -46,3 +53,399 @@ bool check_compo(const TrucsInteressants &trucs, const compo_t &compo,
 
   return !found_error;
 }
+
+/** Number of common factors of the synthetic covariances */
+constexpr unsigned synthetic_nb_factors = 3;
+
+TrucsInteressants synthetic_trucs(unsigned nb_assets, unsigned seed) {
+  auto gen = std::mt19937(seed);
+  auto uniform = std::uniform_real_distribution<double>(0, 1);
+  auto normal = std::normal_distribution<double>(0, 1);
+
+  auto trucs = TrucsInteressants();
+  for (auto i = 0u; i < nb_assets; ++i) {
+    auto start_value = 5 + 100 * uniform(gen);
+    auto nb_shares = 100 + (finmath::nb_shares_t)(100000 * uniform(gen));
+    trucs.start_values.push_back(start_value);
+    trucs.end_values.push_back(start_value * (1 + 0.05 + 0.2 * normal(gen)));
+    trucs.nb_shares.push_back(nb_shares);
+    trucs.assets_id.push_back("SYNTH" + std::to_string(i));
+    trucs.assets_capital.push_back(start_value * nb_shares);
+  }
+
+  // cov = L * L^T + D with the loadings L of the assets on the factors
+  auto loadings = std::vector<double>(nb_assets * synthetic_nb_factors);
+  for (auto &loading : loadings) {
+    loading = 0.01 * normal(gen);
+  }
+  trucs.cov_matrix = finmath::covariance_matrix_t(nb_assets);
+  for (auto i = 0u; i < nb_assets; ++i) {
+    for (auto j = 0u; j <= i; ++j) {
+      double cov = 0;
+      for (auto f = 0u; f < synthetic_nb_factors; ++f) {
+        cov += loadings[i * synthetic_nb_factors + f] *
+               loadings[j * synthetic_nb_factors + f];
+      }
+      if (i == j) {
+        cov += 0.0001 + 0.0004 * uniform(gen);
+      }
+      trucs.cov_matrix(i, j) = cov;
+      trucs.cov_matrix(j, i) = cov;
+    }
+  }
+  return trucs;
+}
+
+/** Max relative difference allowed between a kernel and the reference */
+constexpr double kernel_tolerance = 1e-9;
+
+/** Max difference allowed between the directional derivative of the qp
+ * gradient and its finite difference, relative to the norm of the gradient */
+constexpr double gradient_tolerance = 1e-6;
+
+static double relative_error(double value, double reference) {
+  if (value == reference)
+    return 0;
+  return std::abs(value - reference) /
+         std::max(std::abs(reference), std::numeric_limits<double>::min());
+}
+
+/** Max relative error of the sums and their sharpe */
+static double sums_error(const finmath::PortfolioSums &sums,
+                         const finmath::PortfolioSums &reference) {
+  return std::max({relative_error(sums.start_capital, reference.start_capital),
+                   relative_error(sums.end_capital, reference.end_capital),
+                   relative_error(sums.variance, reference.variance),
+                   relative_error(finmath::sharpe(sums),
+                                  finmath::sharpe(reference))});
+}
+
+/** Max relative error of the best move of each asset of `evaluate_single_moves`
+ * against a scan of every feasible change of its shares from the `reference`
+ * sums of `compo`, and of the sharpe of the moved composition. A move
+ * breaking the %NAV rule of a valid composition is an infinite error.
+ */
+template <unsigned K>
+static double single_moves_error(const SharpeCache<K> &cache,
+                                 const compo_t &compo,
+                                 const finmath::PortfolioSums &reference) {
+  const auto &trucs = cache.trucs;
+  auto moves = evaluate_single_moves(cache);
+  auto valid = check_compo(trucs, compo, false);
+  auto reference_sharpe = finmath::sharpe(reference);
+
+  double error = 0;
+  for (auto i = 0u; i < K; ++i) {
+    auto i_asset = std::get<1>(compo[i]);
+    auto start_value = trucs.start_values[i_asset];
+    auto end_value = trucs.end_values[i_asset];
+    auto self_cov = trucs.cov_matrix(i_asset, i_asset);
+
+    // Covariance of the asset with the portfolio
+    double cov_portfolio = 0;
+    for (const auto &[nb_shares, j_asset] : compo) {
+      cov_portfolio += trucs.cov_matrix(i_asset, j_asset) * nb_shares *
+                       trucs.start_values[j_asset];
+    }
+
+    auto best = reference_sharpe;
+    auto [min_dx, max_dx] = feasible_dshares(cache, i);
+    for (auto dx = min_dx; dx <= max_dx; ++dx) {
+      if (dx == 0)
+        continue;
+
+      auto dw = dx * start_value;
+      best = std::max(best, finmath::sharpe(finmath::PortfolioSums{
+                                reference.start_capital + dw,
+                                reference.end_capital + dx * end_value,
+                                reference.variance +
+                                    dw * (2 * cov_portfolio + dw * self_cov)}));
+    }
+    error = std::max(error, relative_error(moves[i].sharpe, best));
+
+    if (moves[i].dshares != 0) {
+      auto moved_compo = compo;
+      std::get<0>(moved_compo[i]) += moves[i].dshares;
+      auto moved_sharpe = finmath::sharpe(finmath::reference::portfolio_sums(
+          trucs.cov_matrix, trucs.start_values, trucs.end_values,
+          moved_compo));
+      error = std::max(error, relative_error(moves[i].sharpe, moved_sharpe));
+      if (valid && !check_compo(trucs, moved_compo, false))
+        return INFINITY;
+    }
+  }
+  return error;
+}
+
+bool check_sharpe_kernels(const TrucsInteressants &trucs, unsigned nb_samples,
+                          bool verbose) {
+  auto nb_assets = trucs.assets_id.size();
+  if (nb_assets < min_portfolio_size)
+    return true;
+
+  // Fixed seed to be able to reproduce the errors
+  auto gen = std::mt19937(42);
+  auto all_assets = std::vector<share_index_t>(nb_assets);
+  std::iota(all_assets.begin(), all_assets.end(), 0);
+  auto order = assets_by_capital(trucs);
+
+  // Max relative error of each kernel
+  auto names = std::vector<std::string_view>{
+      "quadratic_form",
+      "portfolio_sums",
+      "compute_sharpe (tree)",
+      "compute_sharpe_init_chache",
+      "recompute_sharpe",
+      "undo_change",
+      "swap_asset",
+      "finmath::compute_sharpe",
+      "tree_leaf_sums",
+      "beam_leaf_sums",
+      "evaluate_single_moves",
+      "qp_sharpe_gradient (sharpe)",
+      "qp_sharpe_gradient (gradient)"};
+  auto errors = std::vector<double>(names.size(), 0);
+  auto tolerances = std::vector<double>(names.size(), kernel_tolerance);
+  tolerances[12] = gradient_tolerance;
+
+  auto compo = compo_t();
+  auto weights = std::vector<double>();
+  auto positions = std::vector<unsigned>();
+  auto qp_weights = std::vector<double>();
+  auto gradient = std::vector<double>();
+  auto scratch_gradient = std::vector<double>();
+  for (auto i_sample = 0u; i_sample < nb_samples; ++i_sample) {
+    // Random composition
+    auto size = std::uniform_int_distribution<unsigned>(
+        min_portfolio_size,
+        std::min<unsigned>(max_portfolio_size, nb_assets))(gen);
+    std::shuffle(all_assets.begin(), all_assets.end(), gen);
+
+    // Put roughly the same capital in every asset to respect the %NAV rule
+    double base_capital = 0;
+    for (auto i = 0u; i < size; ++i) {
+      base_capital =
+          std::max(base_capital, 100 * trucs.start_values[all_assets[i]]);
+    }
+
+    compo.resize(0);
+    auto jitter = std::uniform_real_distribution<double>(0.8, 1.25);
+    for (auto i = 0u; i < size; ++i) {
+      auto i_asset = all_assets[i];
+      auto nb_shares = (nb_shares_t)(base_capital * jitter(gen) /
+                                     trucs.start_values[i_asset]);
+      compo.emplace_back(nb_shares, i_asset);
+    }
+
+    auto reference = finmath::reference::portfolio_sums(
+        trucs.cov_matrix, trucs.start_values, trucs.end_values, compo);
+    auto reference_sharpe = finmath::sharpe(reference);
+
+    // Quadratic form kernel against the scalar one
+    weights.resize(0);
+    for (const auto &[nb_shares, i_asset] : compo) {
+      weights.push_back((double)nb_shares * trucs.start_values[i_asset]);
+    }
+    auto assets = std::span<const share_index_t>(all_assets.data(), size);
+    errors[0] = std::max(
+        errors[0],
+        relative_error(
+            finmath::quadratic_form(trucs.cov_matrix, assets, weights),
+            finmath::scalar::quadratic_form(trucs.cov_matrix, assets,
+                                            weights)));
+
+    auto sums = finmath::portfolio_sums(trucs.cov_matrix, trucs.start_values,
+                                        trucs.end_values, compo);
+    errors[1] = std::max(errors[1], sums_error(sums, reference));
+
+    errors[2] = std::max(errors[2], relative_error(compute_sharpe(trucs, compo),
+                                                   reference_sharpe));
+
+    // Sell some shares of an asset and compare with the moved composition
+    auto i_changed = std::uniform_int_distribution<unsigned>(0, size - 1)(gen);
+    auto dshares = -(int)(std::get<0>(compo[i_changed]) / 4);
+    auto moved_compo = compo;
+    std::get<0>(moved_compo[i_changed]) += dshares;
+    auto moved_sharpe = finmath::sharpe(finmath::reference::portfolio_sums(
+        trucs.cov_matrix, trucs.start_values, trucs.end_values, moved_compo));
+
+    dispatch_portfolio_size(size, [&]<unsigned K>() {
+      auto cache = SharpeCache<K>(trucs);
+      auto cache_sharpe_init = compute_sharpe_init_chache(
+          finmath::FixedComposition<K>(compo, trucs.start_values), cache);
+      errors[3] = std::max(errors[3],
+                           relative_error(cache_sharpe_init, reference_sharpe));
+      errors[10] =
+          std::max(errors[10], single_moves_error(cache, compo, reference));
+
+      // Partial sums of the tree and beam searches, on the assets at random
+      // positions of their order filled like `fill_compo`
+      positions.assign(all_assets.begin(), all_assets.begin() + size);
+      std::sort(positions.begin(), positions.end());
+      auto filled = finmath::FixedComposition<K>();
+      for (auto i = 0u; i < K; ++i) {
+        filled.set_asset(i, order[positions[i]], 0, 0);
+      }
+      fill_compo(trucs, filled);
+      auto filled_reference = finmath::reference::portfolio_sums(
+          trucs.cov_matrix, trucs.start_values, trucs.end_values,
+          filled.investments());
+      auto tree_sums = tree_leaf_sums(trucs, order, positions);
+      errors[8] = std::max(errors[8], sums_error(tree_sums, filled_reference));
+      auto beam_sums = beam_leaf_sums(trucs, order, positions);
+      errors[9] = std::max(errors[9], sums_error(beam_sums, filled_reference));
+
+      auto moved_cache_sharpe =
+          recompute_sharpe(cache, i_changed, dshares, false);
+      errors[4] =
+          std::max(errors[4], relative_error(moved_cache_sharpe, moved_sharpe));
+
+      // The undo restores the cache exactly
+      undo_change(cache);
+      if (cache_sharpe(cache) != cache_sharpe_init) {
+        errors[5] = INFINITY;
+      }
+
+      // Swap the asset for one that is not in the composition
+      if (size < nb_assets) {
+        auto swapped_compo = compo;
+        swapped_compo[i_changed] = {std::get<0>(compo[i_changed]),
+                                    all_assets[size]};
+        auto swapped_sharpe =
+            finmath::sharpe(finmath::reference::portfolio_sums(
+                trucs.cov_matrix, trucs.start_values, trucs.end_values,
+                swapped_compo));
+        // The %NAV rule may be broken, only compare the sharpes
+        swap_asset(cache, i_changed, all_assets[size],
+                   std::get<0>(compo[i_changed]), true);
+        errors[6] = std::max(
+            errors[6], relative_error(cache_sharpe(cache), swapped_sharpe));
+      }
+    });
+
+    // Sharpe of the qp from the parts of the capital, and its gradient
+    // against a central finite difference along a random direction
+    qp_weights.resize(0);
+    for (auto weight : weights) {
+      qp_weights.push_back(weight / reference.start_capital);
+    }
+    errors[11] = std::max(
+        errors[11],
+        relative_error(qp_sharpe_gradient(trucs, assets, qp_weights, gradient),
+                       reference_sharpe));
+
+    auto normal = std::normal_distribution<double>(0, 1);
+    auto step = 1e-7;
+    auto forward = qp_weights;
+    auto backward = qp_weights;
+    double derivative = 0;
+    double gradient_norm = 0;
+    double direction_norm = 0;
+    for (auto i = 0u; i < size; ++i) {
+      auto direction = normal(gen);
+      forward[i] += step * direction;
+      backward[i] -= step * direction;
+      derivative += gradient[i] * direction;
+      gradient_norm += gradient[i] * gradient[i];
+      direction_norm += direction * direction;
+    }
+    auto difference =
+        (qp_sharpe_gradient(trucs, assets, forward, scratch_gradient) -
+         qp_sharpe_gradient(trucs, assets, backward, scratch_gradient)) /
+        (2 * step);
+    auto norm = std::max(std::sqrt(gradient_norm * direction_norm),
+                         std::numeric_limits<double>::min());
+    errors[12] =
+        std::max(errors[12], std::abs(derivative - difference) / norm);
+
+    auto portfolio = finmath::portfolio_t{moved_compo, 0};
+    errors[7] = std::max(
+        errors[7], relative_error(finmath::compute_sharpe(
+                                      trucs.cov_matrix, portfolio,
+                                      trucs.start_values, trucs.end_values),
+                                  moved_sharpe));
+  }
+
+  auto valid = true;
+  if (verbose) {
+    std::cout << "Quadratic form kernel: " << finmath::quadratic_form_kernel()
+              << '\n';
+  }
+  for (auto i = 0u; i < names.size(); ++i) {
+    auto kernel_valid = errors[i] <= tolerances[i];
+    valid &= kernel_valid;
+
+    if (verbose) {
+      std::cout << "- " << names[i] << ": max relative error " << errors[i]
+                << (kernel_valid ? "\n" : "\t!!!ERROR!!!\n");
+    }
+  }
+
+  return valid;
+}
+
+/** Next combination of `positions.size()` positions among n in lexicographic
+ * order
+ * \return false after the last combination
+ */
+static bool next_combination(std::vector<unsigned> &positions, unsigned n) {
+  auto k = (unsigned)positions.size();
+  for (auto i = k; i-- > 0;) {
+    if (positions[i] < n - k + i) {
+      ++positions[i];
+      std::iota(positions.begin() + i + 1, positions.end(), positions[i] + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool check_combinadic(unsigned max_n, bool verbose) {
+  auto binomials = Binomials(max_n, max_n);
+  auto nb_errors = 0u;
+
+  for (auto n = 1u; n <= max_n; ++n) {
+    for (auto k = 1u; k <= n; ++k) {
+      auto positions = std::vector<unsigned>(k);
+      std::iota(positions.begin(), positions.end(), 0);
+
+      rank_t expected_rank = 0;
+      do {
+        auto rank = combination_rank(positions, n, k, binomials);
+        auto error = rank != expected_rank ||
+                     combination_unrank(rank, n, k, binomials) != positions;
+
+        // Every prefix starts a subtree holding the rank
+        for (auto depth = 1u; depth < k; ++depth) {
+          auto prefix = std::span<const unsigned>(positions.data(), depth);
+          auto first = combination_rank(prefix, n, k, binomials);
+          auto size = binomials(n - 1 - prefix.back(), k - depth);
+          error |= rank < first || rank >= first + size;
+        }
+
+        if (error) {
+          ++nb_errors;
+          if (verbose) {
+            std::cout << "- C(" << n << ", " << k << ") rank "
+                      << to_string(expected_rank) << "\t!!!ERROR!!!\n";
+          }
+        }
+        ++expected_rank;
+      } while (next_combination(positions, n));
+
+      if (expected_rank != binomials(n, k)) {
+        ++nb_errors;
+        if (verbose) {
+          std::cout << "- C(" << n << ", " << k << ") counted "
+                    << to_string(expected_rank) << "\t!!!ERROR!!!\n";
+        }
+      }
+    }
+  }
+
+  if (verbose) {
+    std::cout << "Combination ranks up to n = " << max_n << ": " << nb_errors
+              << " errors\n";
+  }
+  return nb_errors == 0;
+}
@@ -4,3 +4,26 @@
 
 bool check_compo(const TrucsInteressants &trucs, const compo_t &compo,
                  bool verbose);
+
+/** Random market of `nb_assets` assets, the same for a given seed, to check
+ * the kernels without the JUMP data. The returns are normal and the
+ * covariance follows a factor model plus a positive diagonal, so it is
+ * symmetric positive definite.
+ */
+TrucsInteressants synthetic_trucs(unsigned nb_assets, unsigned seed);
+
+/** Compare the sharpe computed by the kernels of every solver with the slow
+ * reference, on random compositions.
+ * \return true if every kernel stays within the tolerance of the reference
+ */
+bool check_sharpe_kernels(const TrucsInteressants &trucs, unsigned nb_samples,
+                          bool verbose);
+
+/** Rank and unrank every combination of k among n in the order the tree
+ * search explores them, for small n and k: the ranks must count the
+ * combinations in this order, the unranked combinations must be the ranked
+ * ones, and the subtree of each prefix must hold the ranks of its
+ * combinations.
+ * \return true if every rank is consistent
+ */
+bool check_combinadic(unsigned max_n, bool verbose);
@@ -0,0 +1,87 @@
+#include "combinadic.hpp"
+
+#include <algorithm>
+
+/** Value of the coefficients that do not fit in a rank */
+constexpr rank_t saturated_rank = ~rank_t(0);
+
+Binomials::Binomials(unsigned n_max, unsigned k_max)
+    : k_max_(k_max), table_((n_max + 1) * (k_max + 1), 0) {
+  auto width = k_max + 1;
+  for (auto n = 0u; n <= n_max; ++n) {
+    table_[n * width] = 1;
+    for (auto k = 1u; k <= std::min(n, k_max); ++k) {
+      // Pascal's rule, saturated on overflow
+      auto a = table_[(n - 1) * width + k - 1];
+      auto b = k < n ? table_[(n - 1) * width + k] : 0;
+      table_[n * width + k] = a > saturated_rank - b ? saturated_rank : a + b;
+    }
+  }
+}
+
+bool Binomials::overflows(unsigned n, unsigned k) const {
+  return (*this)(n, k) == saturated_rank;
+}
+
+rank_t combination_rank(std::span<const unsigned> positions, unsigned n,
+                        unsigned k, const Binomials &binomials) {
+  rank_t rank = 0;
+  auto next = 0u;
+  for (auto i = 0u; i < positions.size(); ++i) {
+    rank = extend_rank(rank, next, positions[i], n, k - i, binomials);
+    next = positions[i] + 1;
+  }
+  return rank;
+}
+
+std::vector<unsigned> combination_unrank(rank_t rank, unsigned n, unsigned k,
+                                         const Binomials &binomials) {
+  auto positions = std::vector<unsigned>();
+  positions.reserve(k);
+
+  auto pos = 0u;
+  for (auto i = 0u; i < k; ++i) {
+    // Skip the subtrees of the positions before the one of the rank
+    while (rank >= binomials(n - 1 - pos, k - 1 - i)) {
+      rank -= binomials(n - 1 - pos, k - 1 - i);
+      ++pos;
+    }
+    positions.push_back(pos++);
+  }
+  return positions;
+}
+
+RankRange rank_slice(rank_t total, unsigned index, unsigned count) {
+  // The first `total % count` slices have one more rank
+  auto size = total / count;
+  auto remainder = total % count;
+  auto first = size * index + std::min<rank_t>(index, remainder);
+  return RankRange{first, first + size + (index < remainder ? 1 : 0)};
+}
+
+std::string to_string(rank_t rank) {
+  auto str = std::string();
+  do {
+    str.push_back('0' + unsigned(rank % 10));
+    rank /= 10;
+  } while (rank != 0);
+  std::reverse(str.begin(), str.end());
+  return str;
+}
+
+std::optional<rank_t> parse_rank(std::string_view str) {
+  if (str.empty())
+    return std::nullopt;
+
+  rank_t rank = 0;
+  for (auto c : str) {
+    if (c < '0' || c > '9')
+      return std::nullopt;
+
+    auto digit = rank_t(c - '0');
+    if (rank > (saturated_rank - digit) / 10)
+      return std::nullopt;
+    rank = rank * 10 + digit;
+  }
+  return rank;
+}
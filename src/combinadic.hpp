@@ -0,0 +1,73 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Rank of a combination in the lexicographic order of the combinations.
+ * 128 bits are enough for C(n, k) when n is a few hundreds and k small, the
+ * overflow is detected otherwise. */
+__extension__ typedef unsigned __int128 rank_t;
+
+/** Half-open interval [first, last) of combination ranks */
+struct RankRange {
+  rank_t first;
+  rank_t last;
+};
+
+/** Table of the binomial coefficients C(n, k) for every n <= n_max and
+ * k <= k_max. The values that do not fit in a rank are saturated.
+ */
+class Binomials {
+public:
+  Binomials(unsigned n_max, unsigned k_max);
+
+  rank_t operator()(unsigned n, unsigned k) const {
+    return k > n ? 0 : table_[n * (k_max_ + 1) + k];
+  }
+
+  /** Whether C(n, k) does not fit in a rank */
+  bool overflows(unsigned n, unsigned k) const;
+
+private:
+  unsigned k_max_;
+  std::vector<rank_t> table_;
+};
+
+/** Rank of the first combination of k positions in [0, n) starting with a
+ * prefix of rank `prefix_rank` ending before `next`, followed by `pos`.
+ * `nb_missing` positions follow the prefix. One step of `combination_rank`,
+ * to rank the nodes of a tree of combinations incrementally.
+ */
+inline rank_t extend_rank(rank_t prefix_rank, unsigned next, unsigned pos,
+                          unsigned n, unsigned nb_missing,
+                          const Binomials &binomials) {
+  // The combinations starting with the prefix and a position in [next, pos)
+  // are counted with the hockey-stick identity:
+  // sum(C(n - 1 - q, nb_missing - 1) for next <= q < pos)
+  //   = C(n - next, nb_missing) - C(n - pos, nb_missing)
+  return prefix_rank + binomials(n - next, nb_missing) -
+         binomials(n - pos, nb_missing);
+}
+
+/** Rank of the first combination of k positions in [0, n) starting with the
+ * increasing `positions`. When there are k positions, this is the rank of the
+ * combination itself.
+ */
+rank_t combination_rank(std::span<const unsigned> positions, unsigned n,
+                        unsigned k, const Binomials &binomials);
+
+/** Get the k increasing positions of the combination of rank `rank`, which
+ * must be lower than C(n, k) */
+std::vector<unsigned> combination_unrank(rank_t rank, unsigned n, unsigned k,
+                                         const Binomials &binomials);
+
+/** The `index`-th of `count` slices of almost the same size of [0, total) */
+RankRange rank_slice(rank_t total, unsigned index, unsigned count);
+
+std::string to_string(rank_t rank);
+
+/** Parse a decimal rank, nothing if it is not a valid rank */
+std::optional<rank_t> parse_rank(std::string_view str);
@@ -0,0 +1,35 @@
+#include "composition.hpp"
+
+namespace finmath {
+Composition::Composition(const investments_t &investments,
+                         const assets_day_values_t &start_values) {
+  for (const auto &[nb_shares, i_asset] : investments) {
+    push_back(nb_shares, i_asset, start_values[i_asset]);
+  }
+}
+
+double Composition::start_capital() const {
+  double capital = 0;
+  for (auto buy_value : buy_values_) {
+    capital += buy_value;
+  }
+  return capital;
+}
+
+double Composition::end_capital(const assets_day_values_t &end_values) const {
+  double capital = 0;
+  for (auto i = 0u; i < size(); ++i) {
+    capital += (double)shares_[i] * end_values[assets_[i]];
+  }
+  return capital;
+}
+
+investments_t Composition::investments() const {
+  auto investments = investments_t();
+  investments.reserve(size());
+  for (auto i = 0u; i < size(); ++i) {
+    investments.emplace_back(shares_[i], assets_[i]);
+  }
+  return investments;
+}
+} // namespace finmath
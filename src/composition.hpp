@@ -0,0 +1,139 @@
+#pragma once
+
+#include "finmath.hpp"
+#include "small_vector.hpp"
+
+#include <array>
+#include <span>
+
+namespace finmath {
+/** Composition of a portfolio stored as a structure of arrays: the number of
+ * shares, the asset index and the buy value of each asset are in separate
+ * contiguous arrays, so that the kernels can vectorize over each of them.
+ *
+ * Up to `inline_capacity` assets are stored without any allocation.
+ */
+class Composition {
+public:
+  static constexpr std::size_t inline_capacity = 40;
+
+  Composition() = default;
+
+  /** Create the composition of `investments` and compute the buy values */
+  Composition(const investments_t &investments,
+              const assets_day_values_t &start_values);
+
+  std::size_t size() const { return shares_.size(); }
+  bool empty() const { return shares_.empty(); }
+
+  std::span<const asset_share_t> shares() const { return shares_; }
+  std::span<const asset_index_t> assets() const { return assets_; }
+
+  /** `shares * start_value` of each asset */
+  std::span<const double> buy_values() const { return buy_values_; }
+
+  /** Add an asset at the end of the composition */
+  void push_back(asset_share_t nb_shares, asset_index_t i_asset,
+                 double start_value) {
+    shares_.push_back(nb_shares);
+    assets_.push_back(i_asset);
+    buy_values_.push_back(nb_shares * start_value);
+  }
+
+  /** Change the number of shares of the i-th asset of the composition */
+  void set_shares(std::size_t i, asset_share_t nb_shares, double start_value) {
+    shares_[i] = nb_shares;
+    buy_values_[i] = nb_shares * start_value;
+  }
+
+  /** Replace the i-th asset of the composition */
+  void set_asset(std::size_t i, asset_index_t i_asset, asset_share_t nb_shares,
+                 double start_value) {
+    assets_[i] = i_asset;
+    set_shares(i, nb_shares, start_value);
+  }
+
+  void clear() {
+    shares_.clear();
+    assets_.clear();
+    buy_values_.clear();
+  }
+
+  /** Sum of the buy values */
+  double start_capital() const;
+
+  /** Value of the composition at the end of the period */
+  double end_capital(const assets_day_values_t &end_values) const;
+
+  /** Convert to the array of (shares, asset) used outside of the solvers */
+  investments_t investments() const;
+
+private:
+  SmallVector<asset_share_t, inline_capacity> shares_;
+  SmallVector<asset_index_t, inline_capacity> assets_;
+  SmallVector<double, inline_capacity> buy_values_;
+};
+
+/** Composition of exactly K assets, stored like `Composition` but in fixed
+ * size arrays so that the loops over the assets have constant bounds */
+template <unsigned K> class FixedComposition {
+public:
+  FixedComposition() = default;
+
+  /** Create the composition of `investments`, which must have K assets */
+  FixedComposition(const investments_t &investments,
+                   const assets_day_values_t &start_values) {
+    for (auto i = 0u; i < K; ++i) {
+      const auto &[nb_shares, i_asset] = investments[i];
+      set_asset(i, i_asset, nb_shares, start_values[i_asset]);
+    }
+  }
+
+  static constexpr std::size_t size() { return K; }
+
+  std::span<const asset_share_t, K> shares() const { return shares_; }
+  std::span<const asset_index_t, K> assets() const { return assets_; }
+  std::span<const double, K> buy_values() const { return buy_values_; }
+
+  void set_shares(std::size_t i, asset_share_t nb_shares, double start_value) {
+    shares_[i] = nb_shares;
+    buy_values_[i] = nb_shares * start_value;
+  }
+
+  void set_asset(std::size_t i, asset_index_t i_asset, asset_share_t nb_shares,
+                 double start_value) {
+    assets_[i] = i_asset;
+    set_shares(i, nb_shares, start_value);
+  }
+
+  double start_capital() const {
+    double capital = 0;
+    for (auto i = 0u; i < K; ++i) {
+      capital += buy_values_[i];
+    }
+    return capital;
+  }
+
+  double end_capital(const assets_day_values_t &end_values) const {
+    double capital = 0;
+    for (auto i = 0u; i < K; ++i) {
+      capital += (double)shares_[i] * end_values[assets_[i]];
+    }
+    return capital;
+  }
+
+  investments_t investments() const {
+    auto investments = investments_t();
+    investments.reserve(K);
+    for (auto i = 0u; i < K; ++i) {
+      investments.emplace_back(shares_[i], assets_[i]);
+    }
+    return investments;
+  }
+
+private:
+  std::array<asset_share_t, K> shares_{};
+  std::array<asset_index_t, K> assets_{};
+  std::array<double, K> buy_values_{};
+};
+} // namespace finmath
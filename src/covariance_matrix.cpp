@@ -0,0 +1,146 @@
+#include "covariance_matrix.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace finmath {
+namespace {
+/** Alignment of the buffer and of each row */
+constexpr std::size_t cache_line_size = 64;
+
+/** Buffers of at least this size are aligned for and advised to use huge
+ * pages, to reduce the TLB misses when iterating on large matrices */
+constexpr std::size_t huge_page_size = 2 << 20;
+
+/** Header of the binary format */
+constexpr char binary_magic[4] = {'D', 'C', 'O', 'V'};
+constexpr std::uint32_t binary_version = 2;
+
+double *allocate_buffer(std::size_t nb_values) {
+  auto bytes = nb_values * sizeof(double);
+  if (bytes == 0)
+    return nullptr;
+
+  auto alignment = bytes >= huge_page_size ? huge_page_size : cache_line_size;
+  bytes = (bytes + alignment - 1) / alignment * alignment;
+
+  auto ptr = static_cast<double *>(std::aligned_alloc(alignment, bytes));
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+#ifdef __linux__
+  if (alignment == huge_page_size) {
+    // Only an advice: ignore the error if transparent huge pages are disabled
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  }
+#endif
+
+  std::memset(ptr, 0, bytes);
+  return ptr;
+}
+} // namespace
+
+void CovarianceMatrix::BufferDeleter::operator()(double *ptr) const {
+  std::free(ptr);
+}
+
+CovarianceMatrix::CovarianceMatrix(std::size_t size) : size_(size) {
+  constexpr auto values_per_line = cache_line_size / sizeof(double);
+  stride_ = (size + values_per_line - 1) / values_per_line * values_per_line;
+  data_.reset(allocate_buffer(buffer_size()));
+}
+
+CovarianceMatrix::CovarianceMatrix(const CovarianceMatrix &other)
+    : CovarianceMatrix(other.size_) {
+  std::copy_n(other.data(), buffer_size(), data_.get());
+}
+
+CovarianceMatrix &CovarianceMatrix::operator=(const CovarianceMatrix &other) {
+  if (this != &other) {
+    *this = CovarianceMatrix(other);
+  }
+  return *this;
+}
+
+std::size_t CovarianceMatrix::buffer_size() const { return size_ * stride_; }
+
+void CovarianceMatrix::save_binary(std::ostream &os) const {
+  std::uint64_t size = size_;
+
+  os.write(binary_magic, sizeof(binary_magic));
+  os.write(reinterpret_cast<const char *>(&binary_version),
+           sizeof(binary_version));
+  os.write(reinterpret_cast<const char *>(&size), sizeof(size));
+
+  // Do not write the padding of the rows
+  for (auto i = 0u; i < size_; ++i) {
+    os.write(reinterpret_cast<const char *>(row(i).data()),
+             size_ * sizeof(double));
+  }
+}
+
+std::optional<CovarianceMatrix>
+CovarianceMatrix::load_binary(std::istream &is) {
+  char magic[sizeof(binary_magic)];
+  std::uint32_t version;
+  std::uint64_t size;
+
+  is.read(magic, sizeof(magic));
+  is.read(reinterpret_cast<char *>(&version), sizeof(version));
+  is.read(reinterpret_cast<char *>(&size), sizeof(size));
+  if (!is || std::memcmp(magic, binary_magic, sizeof(magic)) != 0 ||
+      version != binary_version)
+    return std::nullopt;
+
+  // Check the size against the rest of the stream before allocating, so that
+  // a truncated or corrupted file is not trusted for gigabytes of memory
+  auto values_start = is.tellg();
+  is.seekg(0, std::ios::end);
+  auto values_end = is.tellg();
+  is.seekg(values_start);
+  if (!is || values_start < 0 || values_end < values_start)
+    return std::nullopt;
+  auto nb_values = std::uint64_t(values_end - values_start) / sizeof(double);
+  if (size != 0 && size > nb_values / size)
+    return std::nullopt;
+
+  auto m = CovarianceMatrix(size);
+  for (auto i = 0u; i < size; ++i) {
+    is.read(reinterpret_cast<char *>(m.row(i).data()), size * sizeof(double));
+  }
+
+  if (!is)
+    return std::nullopt;
+  return m;
+}
+
+void to_json(nlohmann::json &j, const CovarianceMatrix &m) {
+  j = nlohmann::json::array();
+  for (auto i = 0u; i < m.size(); ++i) {
+    auto &j_row = j.emplace_back(nlohmann::json::array());
+    for (auto k = 0u; k < m.size(); ++k) {
+      j_row.push_back(m(i, k));
+    }
+  }
+}
+
+void from_json(const nlohmann::json &j, CovarianceMatrix &m) {
+  m = CovarianceMatrix(j.size());
+  for (auto i = 0u; i < m.size(); ++i) {
+    const auto &j_row = j.at(i);
+    if (j_row.size() != m.size())
+      throw std::invalid_argument("Covariance matrix is not square");
+
+    for (auto k = 0u; k < m.size(); ++k) {
+      m(i, k) = j_row.at(k).get<double>();
+    }
+  }
+}
+} // namespace finmath
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+
+#include <nlohmann/json.hpp>
+
+namespace finmath {
+/** Symmetric matrix of covariances between each pair of assets.
+ *
+ * The values are stored in one 64-byte aligned buffer, as full rows padded to
+ * a multiple of 64 bytes.
+ * Large matrices are allocated on huge pages when the system allows it.
+ */
+class CovarianceMatrix {
+public:
+  CovarianceMatrix() = default;
+
+  /** Create a zero-filled matrix of `size` assets */
+  explicit CovarianceMatrix(std::size_t size);
+
+  CovarianceMatrix(const CovarianceMatrix &other);
+  CovarianceMatrix(CovarianceMatrix &&other) noexcept = default;
+  CovarianceMatrix &operator=(const CovarianceMatrix &other);
+  CovarianceMatrix &operator=(CovarianceMatrix &&other) noexcept = default;
+
+  /** Number of assets */
+  std::size_t size() const { return size_; }
+
+  /** Covariance between the assets i and j */
+  double operator()(std::size_t i, std::size_t j) const {
+    return data_.get()[i * stride_ + j];
+  }
+  double &operator()(std::size_t i, std::size_t j) {
+    return data_.get()[i * stride_ + j];
+  }
+
+  /** Covariances of the asset i with every asset */
+  std::span<const double> row(std::size_t i) const {
+    return {data_.get() + i * stride_, size_};
+  }
+  std::span<double> row(std::size_t i) {
+    return {data_.get() + i * stride_, size_};
+  }
+
+  std::span<const double> operator[](std::size_t i) const { return row(i); }
+  std::span<double> operator[](std::size_t i) { return row(i); }
+
+  /** Distance between the start of two rows */
+  std::size_t stride() const { return stride_; }
+
+  const double *data() const { return data_.get(); }
+
+  /** Write the matrix in a compact binary format */
+  void save_binary(std::ostream &os) const;
+
+  /** Read a matrix written by `save_binary`, or nothing if the stream does not
+   * hold a complete matrix */
+  static std::optional<CovarianceMatrix> load_binary(std::istream &is);
+
+private:
+  struct BufferDeleter {
+    void operator()(double *ptr) const;
+  };
+
+  /** Number of values in the buffer */
+  std::size_t buffer_size() const;
+
+  std::size_t size_ = 0;
+  std::size_t stride_ = 0;
+  std::unique_ptr<double[], BufferDeleter> data_;
+};
+
+/** Serialize as an array of rows */
+void to_json(nlohmann::json &j, const CovarianceMatrix &m);
+void from_json(const nlohmann::json &j, CovarianceMatrix &m);
+} // namespace finmath
@@ -1,4 +1,6 @@
 #include "finmath.hpp"
+#include "quadform.hpp"
+#include "sharpe.hpp"
 
 namespace finmath {
 double compute_covariance(const asset_period_values_t &x_values,
@@ -15,14 +17,16 @@ double compute_covariance(const asset_period_values_t &x_values,
 double compute_volatility(const covariance_matrix_t &cov_matrix,
                           const portfolio_t &portfolio,
                           const assets_day_values_t &start_values) {
-  double vol = 0;
-  for (const auto &[share1, asset1] : portfolio.investments) {
-    double inner_sum = 0;
-    for (const auto &[share2, asset2] : portfolio.investments) {
-      inner_sum += share2 * start_values[asset2] * cov_matrix[asset1][asset2];
-    }
-    vol += share1 * start_values[asset1] * inner_sum;
+  auto assets = std::vector<asset_index_t>();
+  auto buy_values = std::vector<double>();
+  assets.reserve(portfolio.investments.size());
+  buy_values.reserve(portfolio.investments.size());
+  for (const auto &[share, asset] : portfolio.investments) {
+    assets.push_back(asset);
+    buy_values.push_back(share * start_values[asset]);
   }
+
+  auto vol = quadratic_form(cov_matrix, assets, buy_values);
   return vol / (CAPITAL_START * CAPITAL_START);
 }
 
@@ -39,14 +43,13 @@ double compute_sharpe(const covariance_matrix_t &cov_matrix,
                       const portfolio_t &portfolio,
                       const assets_day_values_t &start_values,
                       const assets_day_values_t &end_values) {
-  // Compute the capital at the end of the period
-  auto sell_value = compute_sell_value(portfolio, end_values);
-  auto capital_end = sell_value + portfolio.not_invested_capital;
+  auto sums = portfolio_sums(cov_matrix, start_values, end_values,
+                             portfolio.investments);
 
-  // Compute the return of the investment and the return of a no-risk investment
-  auto inv_return = capital_end / CAPITAL_START;
+  // The capital that has not been invested keeps its value
+  sums.start_capital += portfolio.not_invested_capital;
+  sums.end_capital += portfolio.not_invested_capital;
 
-  auto vol = compute_volatility(cov_matrix, portfolio, start_values);
-  return inv_return / vol;
+  return sharpe(sums);
 }
 } // namespace finmath
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "covariance_matrix.hpp"
 #include "jump/types.hpp"
 
 #include <optional>
@@ -26,17 +27,20 @@ using asset_share_t = unsigned;
 /** The index of the asset (e.g. in the covariance matrix) */
 using asset_index_t = unsigned;
 
+/** The invested assets: number of shares and index of each asset */
+using investments_t = std::vector<std::tuple<asset_share_t, asset_index_t>>;
+
 /** A investment portfolio */
 struct portfolio_t {
   /** The invested assets and their weight in the portfolio */
-  std::vector<std::tuple<asset_share_t, asset_index_t>> investments;
+  investments_t investments;
 
   /** The capital that have not been invested */
   asset_share_t not_invested_capital;
 };
 
 /** The matrix of covariance for each pair of assets */
-using covariance_matrix_t = std::vector<std::vector<double>>;
+using covariance_matrix_t = CovarianceMatrix;
 
 /** Value for each asset at a specific day */
 using assets_day_values_t = std::vector<asset_day_value_t>;
@@ -1,24 +1,39 @@
+#include "annealing.hpp"
+#include "beam.hpp"
 #include "check.hpp"
 #include "jump/client.hpp"
 #include "jump/types_json.hpp"
+#include "prescreen.hpp"
+#include "qp.hpp"
 #include "save_data.hpp"
 #include "stochastic.hpp"
 #include "tree.hpp"
 
 #include <cassert>
 #include <filesystem>
+#include <cmath>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <thread>
 
 #include <CLI/CLI.hpp>
 
 constexpr auto VERBOSE = true;
 
+/** Size and seed of the synthetic market of the check-kernels mode */
+constexpr unsigned check_nb_assets = 200;
+constexpr unsigned check_seed = 42;
+
 namespace FinalPortfolio {
 static auto portfolio_folder = std::filesystem::current_path() / "portfolio";
 static auto best_portfolio_path = portfolio_folder / "best_portfolio.json";
 static auto new_portfolio_path = portfolio_folder / "new_portfolio.json";
+static auto ranked_portfolios_path =
+    portfolio_folder / "ranked_portfolios.json";
+static auto frontier_path = portfolio_folder / "frontier.json";
 
 static JumpTypes::Portfolio load_portfolio(const std::filesystem::path &path) {
   auto f = std::ifstream(path);
@@ -46,9 +61,8 @@ static void save_portfolio(const std::filesystem::path &path,
   f << json(new_portfolio) << '\n';
 }
 
-compo_t best_compo(const TrucsInteressants &trucs) {
-  const auto portfolio =
-      FinalPortfolio::load_portfolio(FinalPortfolio::best_portfolio_path);
+compo_t to_compo(const TrucsInteressants &trucs,
+                 const JumpTypes::Portfolio &portfolio) {
   const auto &values = portfolio.values.find("2016-06-01")->second;
 
   auto compo = compo_t();
@@ -69,6 +83,11 @@ compo_t best_compo(const TrucsInteressants &trucs) {
   return compo;
 }
 
+compo_t best_compo(const TrucsInteressants &trucs) {
+  return to_compo(trucs, FinalPortfolio::load_portfolio(
+                             FinalPortfolio::best_portfolio_path));
+}
+
 JumpTypes::Portfolio to_portfolio(const TrucsInteressants &trucs,
                                   const compo_t &compo) {
   auto new_values = std::vector<JumpTypes::portfolio_value>();
@@ -87,6 +106,201 @@ JumpTypes::Portfolio to_portfolio(const TrucsInteressants &trucs,
           {{std::string("2016-06-01"), new_values}}};
 }
 
+/** A portfolio of a ranked portfolios file and its sharpe */
+struct RankedPortfolio {
+  double sharpe;
+  JumpTypes::Portfolio portfolio;
+};
+
+/** Save portfolios ranked by decreasing sharpe */
+static void
+write_ranked_portfolios(const std::vector<RankedPortfolio> &ranked) {
+  const auto &path = ranked_portfolios_path;
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path());
+  }
+
+  auto f = std::ofstream(path);
+  if (!f.good()) {
+    std::cerr << "Could not save portfolios in '" << path << "'\n";
+    exit(EXIT_FAILURE);
+  }
+
+  auto j = json::array();
+  auto rank = 1u;
+  for (const auto &[sharpe, portfolio] : ranked) {
+    j.push_back(
+        {{"rank", rank++}, {"sharpe", sharpe}, {"portfolio", portfolio}});
+  }
+  f << j << '\n';
+
+  std::clog << "Saved " << ranked.size() << " portfolios in " << path << '\n';
+}
+
+/** Save the results as a list of portfolios ranked by decreasing sharpe */
+static void save_ranked_portfolios(const TrucsInteressants &trucs,
+                                   const TopCompos &results) {
+  auto ranked = std::vector<RankedPortfolio>();
+  for (const auto &[sharpe, compo, _hash] : results.ranked()) {
+    ranked.push_back({sharpe, to_portfolio(trucs, compo)});
+  }
+  write_ranked_portfolios(ranked);
+}
+
+/** Save the points of the frontier, as a CSV table if the path ends with
+ * `.csv` and as JSON with their rounded portfolios otherwise */
+static void save_frontier(const TrucsInteressants &trucs,
+                          const std::vector<FrontierPoint> &points) {
+  const auto &path = frontier_path;
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path());
+  }
+
+  auto f = std::ofstream(path);
+  if (!f.good()) {
+    std::cerr << "Could not save the frontier in '" << path << "'\n";
+    exit(EXIT_FAILURE);
+  }
+
+  // The points without a solution have -inf sharpes, left empty or null
+  if (path.extension() == ".csv") {
+    auto write_sharpe = [&f](double sharpe) {
+      if (!std::isinf(sharpe)) {
+        f << sharpe;
+      }
+    };
+
+    f << std::setprecision(std::numeric_limits<double>::digits10 + 1);
+    f << "portfolio_size,max_weight,relaxed_sharpe,sharpe,nb_iterations,"
+         "rounded_sharpe\n";
+    for (const auto &point : points) {
+      f << point.portfolio_size << ',' << point.max_weight << ',';
+      write_sharpe(point.relaxed_sharpe);
+      f << ',';
+      write_sharpe(point.sharpe);
+      f << ',' << point.nb_iterations << ',';
+      write_sharpe(point.rounded_sharpe);
+      f << '\n';
+    }
+  } else {
+    auto finite = [](double sharpe) {
+      return std::isinf(sharpe) ? json(nullptr) : json(sharpe);
+    };
+
+    auto j = json::array();
+    for (const auto &point : points) {
+      auto portfolio = json(nullptr);
+      if (!point.compo.empty()) {
+        portfolio = to_portfolio(trucs, point.compo);
+      }
+      j.push_back({{"portfolio_size", point.portfolio_size},
+                   {"max_weight", point.max_weight},
+                   {"relaxed_sharpe", finite(point.relaxed_sharpe)},
+                   {"sharpe", finite(point.sharpe)},
+                   {"nb_iterations", point.nb_iterations},
+                   {"rounded_sharpe", finite(point.rounded_sharpe)},
+                   {"portfolio", portfolio}});
+    }
+    f << j << '\n';
+  }
+
+  std::clog << "Saved " << points.size() << " frontier points in " << path
+            << '\n';
+}
+
+/** Load the portfolios saved by `save_ranked_portfolios` */
+static std::vector<RankedPortfolio>
+load_ranked_portfolios(const std::filesystem::path &path) {
+  auto f = std::ifstream(path);
+  if (!f.good()) {
+    std::cerr << "Could not load portfolios in '" << path << "'\n";
+    exit(EXIT_FAILURE);
+  }
+
+  json j;
+  f >> j;
+
+  auto ranked = std::vector<RankedPortfolio>();
+  for (const auto &j_ranked : j) {
+    ranked.push_back({j_ranked.at("sharpe").get<double>(),
+                      j_ranked.at("portfolio").get<JumpTypes::Portfolio>()});
+  }
+  return ranked;
+}
+
+/** The sorted (asset id, shares) pairs of a portfolio, which identify it */
+static std::vector<std::pair<int32_t, double>>
+portfolio_holdings(const JumpTypes::Portfolio &portfolio) {
+  auto holdings = std::vector<std::pair<int32_t, double>>();
+  auto values = portfolio.values.find("2016-06-01");
+  if (values != portfolio.values.end()) {
+    for (const auto &[asset, _currency] : values->second) {
+      if (asset) {
+        holdings.emplace_back(asset->asset, asset->quantity);
+      }
+    }
+  }
+  std::sort(holdings.begin(), holdings.end());
+  return holdings;
+}
+
+/** Composition of the best portfolio of the ranked portfolios files, so that
+ * a mode can start from the results of another one */
+static compo_t best_ranked_compo(const TrucsInteressants &trucs,
+                                 const std::vector<std::string> &inputs) {
+  auto best = std::optional<RankedPortfolio>();
+  for (const auto &input : inputs) {
+    for (auto &ranked : load_ranked_portfolios(input)) {
+      if (!best || ranked.sharpe > best->sharpe) {
+        best = std::move(ranked);
+      }
+    }
+  }
+  if (!best) {
+    std::cerr << "No portfolio to start from in the input files\n";
+    exit(EXIT_FAILURE);
+  }
+  return to_compo(trucs, best->portfolio);
+}
+
+/** Composition to start from: the best portfolio of the ranked portfolios
+ * files when there are some, the best portfolio otherwise */
+static compo_t start_compo(const TrucsInteressants &trucs,
+                           const std::vector<std::string> &inputs) {
+  return inputs.empty() ? best_compo(trucs) : best_ranked_compo(trucs, inputs);
+}
+
+/** Save the `nb_results` best distinct portfolios of the ranked portfolios
+ * files, without the trucs: the portfolios are compared by their holdings */
+static void merge_ranked_portfolios(const std::vector<std::string> &inputs,
+                                    unsigned nb_results) {
+  auto best = std::map<std::vector<std::pair<int32_t, double>>,
+                       RankedPortfolio>();
+  for (const auto &input : inputs) {
+    for (auto &ranked : load_ranked_portfolios(input)) {
+      auto holdings = portfolio_holdings(ranked.portfolio);
+      auto [it, inserted] = best.try_emplace(std::move(holdings), ranked);
+      if (!inserted && ranked.sharpe > it->second.sharpe) {
+        it->second = std::move(ranked);
+      }
+    }
+  }
+
+  auto merged = std::vector<RankedPortfolio>();
+  merged.reserve(best.size());
+  for (auto &[_holdings, ranked] : best) {
+    merged.push_back(std::move(ranked));
+  }
+  std::stable_sort(merged.begin(), merged.end(),
+                   [](const auto &a, const auto &b) {
+                     return a.sharpe > b.sharpe;
+                   });
+  if (merged.size() > nb_results) {
+    merged.resize(nb_results);
+  }
+  write_ranked_portfolios(merged);
+}
+
 std::string get_sharpe(JumpClient &client) {
   auto ratios = std::vector<int32_t>();
   ratios.emplace_back(12);
@@ -181,66 +395,6 @@ static TrucsInteressants get_the_trucs_interessants(JumpClient &client) {
                            nb_shares,    assets_id,  assets_capital};
 }
 
-static void thread_worker(const TrucsInteressants &trucs,
-                          std::tuple<compo_t, sharpe_t> &result,
-                          unsigned i_thread) {
-  auto compo = compo_t();
-  compo.reserve(40);
-  compo.emplace_back(-1, i_thread);
-
-  auto shares_capital = finmath::asset_period_values_t();
-  shares_capital.reserve(40);
-
-  result = max_compo_tree2(trucs, shares_capital, compo, i_thread + 1);
-}
-
-static std::tuple<compo_t, sharpe_t>
-max_compo_tree_multithread(const TrucsInteressants &trucs) {
-  auto nb_threads = trucs.assets_id.size() - min_portfolio_size;
-
-  auto threads = std::vector<std::thread>();
-  threads.reserve(nb_threads);
-
-  auto results = std::vector<std::tuple<compo_t, sharpe_t>>(nb_threads);
-
-  for (auto i = 0u; i < nb_threads; ++i) {
-    threads.emplace_back(thread_worker, std::ref(trucs), std::ref(results[i]),
-                         i);
-  }
-
-  compo_t best_compo;
-  sharpe_t best_sharpe = -INFINITY;
-
-  for (auto i = 0u; i < nb_threads; ++i) {
-    threads[nb_threads - i - 1].join();
-
-    const auto &[compo, sharpe] = results[nb_threads - i - 1];
-    if (sharpe > best_sharpe) {
-      best_sharpe = sharpe;
-      best_compo = compo;
-    }
-
-    std::clog << "\n=========\nA thread has completed\n";
-    if (best_sharpe == -INFINITY) {
-      std::clog << "No composition found\n";
-    } else {
-      std::clog << "Current best composition:\n";
-
-      std::cout << "Sharpe: " << best_sharpe << '\n';
-      std::cout << "List of (asset_id, bought_shares):\n";
-      for (const auto &[nb_shares, i_asset] : best_compo) {
-        std::cout << "- " << trucs.assets_id[i_asset] << "\t" << nb_shares
-                  << '\n';
-      }
-    }
-  }
-
-  return *std::max_element(results.begin(), results.end(),
-                           [](const auto &a, const auto &b) {
-                             return std::get<1>(b) > std::get<1>(a);
-                           });
-}
-
 /** Push the portfolio in `new_portfolio_path` and copy it to
  * `best_portfolio_path` */
 static void push_portfolio(JumpClient &client,
@@ -267,9 +421,9 @@ static void check_portfolio(const TrucsInteressants &trucs) {
 }
 
 static void optimize_portfolio(const TrucsInteressants &trucs,
-                               JumpClient &client) {
-  auto compo = FinalPortfolio::best_compo(trucs);
-
+                               JumpClient &client, const compo_t &compo,
+                               unsigned portfolio_size, unsigned nb_results,
+                               unsigned nb_chains) {
   auto old_sharpe = FinalPortfolio::get_sharpe(client);
 
   std::cout << "---\n";
@@ -285,7 +439,10 @@ static void optimize_portfolio(const TrucsInteressants &trucs,
     std::replace(sharpe_str.begin(), sharpe_str.end(), ',', '.');
     return std::stod(sharpe_str);
   };
-  auto new_compo = find_best_compo_stochastic(trucs, compo, get_sharpe);
+  auto results = find_best_compo_stochastic(
+      trucs, compo, get_sharpe, portfolio_size, nb_results, nb_chains);
+  FinalPortfolio::save_ranked_portfolios(trucs, results);
+  auto new_compo = results.ranked().front().compo;
 
   if (!check_compo(trucs, new_compo, true)) {
     std::cerr << "Optimized compo is not valid\n";
@@ -365,32 +522,275 @@ static void optimize_hard(const TrucsInteressants &trucs, JumpClient &client) {
   push_portfolio(client, best_portfolio);
 }
 
+/** Parse a `i/n` shard of the tree search */
+static void parse_shard(const std::string &str, TreeSlice &slice) {
+  auto separator = str.find('/');
+  try {
+    slice.shard_index = std::stoul(str.substr(0, separator));
+    slice.nb_shards = std::stoul(str.substr(separator + 1));
+  } catch (const std::exception &) {
+    separator = std::string::npos;
+  }
+
+  if (separator == std::string::npos ||
+      slice.shard_index >= slice.nb_shards) {
+    std::cerr << "Invalid shard '" << str << "', expected i/n with i < n\n";
+    exit(EXIT_FAILURE);
+  }
+}
+
+/** Parse a `a:b` range of ranks */
+static RankRange parse_rank_range(const std::string &str) {
+  auto separator = str.find(':');
+  if (separator != std::string::npos) {
+    auto first = parse_rank(std::string_view(str).substr(0, separator));
+    auto last = parse_rank(std::string_view(str).substr(separator + 1));
+    if (first && last && *first <= *last)
+      return RankRange{*first, *last};
+  }
+
+  std::cerr << "Invalid rank range '" << str << "', expected a:b with a <= b\n";
+  exit(EXIT_FAILURE);
+}
+
+/** Parse a `a:b` range of portfolio sizes */
+static void parse_size_range(const std::string &str, FrontierParams &params) {
+  auto separator = str.find(':');
+  try {
+    params.min_size = std::stoul(str.substr(0, separator));
+    params.max_size = std::stoul(str.substr(separator + 1));
+  } catch (const std::exception &) {
+    separator = std::string::npos;
+  }
+
+  if (separator == std::string::npos || params.min_size > params.max_size ||
+      params.min_size < min_portfolio_size ||
+      params.max_size > max_portfolio_size) {
+    std::cerr << "Invalid sizes '" << str << "', expected a:b with "
+              << min_portfolio_size << " <= a <= b <= " << max_portfolio_size
+              << '\n';
+    exit(EXIT_FAILURE);
+  }
+}
+
+/** Save the ranked portfolios found by a solver and display the best one */
+static int save_results(const TrucsInteressants &trucs,
+                        const TopCompos &results) {
+  FinalPortfolio::save_ranked_portfolios(trucs, results);
+  if (results.empty()) {
+    std::cerr << "No portfolio found\n";
+    return EXIT_FAILURE;
+  }
+
+  // Display the best portfolio found
+  auto ranked = results.ranked();
+  const auto &[best_sharpe, best_compo, _hash] = ranked.front();
+  std::cout << "\nBest portfolio found:\n";
+  std::cout << "Sharpe: " << best_sharpe << '\n';
+  std::cout << "List of (asset_id, bought_shares):\n";
+  for (const auto &[nb_shares, i_asset] : best_compo) {
+    std::cout << "- " << trucs.assets_id[i_asset] << "\t" << nb_shares
+              << '\n';
+  }
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
   std::string username, password, mode;
+  unsigned portfolio_size = max_portfolio_size;
+  unsigned nb_results = 1;
+  unsigned time_budget = 0;
+  unsigned beam_width = default_beam_width;
+  bool prescreen = false;
+  unsigned nb_chains = 0;
+  auto annealing = AnnealingParams();
+  std::string schedule = "geometric";
+  auto qp = QpParams();
+  auto frontier = FrontierParams();
+  std::string frontier_sizes;
+  std::string shard, rank_range, output;
+  std::vector<std::string> inputs;
 
   // Parse the command line arguments
   auto app = CLI::App{"Dolphin"};
-  app.add_option("-u,--username", username, "JUMP account username")
-      ->required();
-  app.add_option("-p,--password", password, "JUMP account password")
-      ->required();
+  auto username_opt = app.add_option("-u,--username", username,
+                                     "JUMP account username, required by "
+                                     "every mode but check-kernels and merge");
+  auto password_opt = app.add_option("-p,--password", password,
+                                     "JUMP account password, required by "
+                                     "every mode but check-kernels and merge");
   app.add_option("-m,--mode", mode, "The action to do")
       ->required()
-      ->check(CLI::IsMember(
-          {"check", "push", "compute-brute", "optimize", "optimize-hard"}));
+      ->check(CLI::IsMember({"check", "check-kernels", "push", "compute-brute",
+                             "beam", "optimize", "optimize-hard", "anneal",
+                             "qp", "frontier", "merge"}));
+  auto portfolio_size_opt =
+      app.add_option("-k,--portfolio-size", portfolio_size,
+                     "Number of assets of the searched portfolios")
+          ->check(CLI::Range(min_portfolio_size, max_portfolio_size));
+  app.add_option("-n,--nb-results", nb_results,
+                 "Number of best portfolios to keep and save")
+      ->check(CLI::Range(1u, 10000u));
+  app.add_option("--shard", shard,
+                 "compute-brute: only explore the i-th of n slices, as i/n");
+  app.add_option("--rank-range", rank_range,
+                 "compute-brute: only explore the compositions whose rank is "
+                 "in [a, b), as a:b");
+  app.add_option("--time-budget", time_budget,
+                 "compute-brute: stop after this number of seconds and keep "
+                 "the best portfolios found so far, 0 for no limit");
+  app.add_option("--beam-width", beam_width,
+                 "beam: number of partial portfolios kept at each step. Each "
+                 "one holds a double per asset and two steps of them are "
+                 "alive at once, so the search needs about 16 bytes per "
+                 "asset times the width, up to 4 GiB")
+      ->check(CLI::Range(1u, 1000000u));
+  app.add_option("--nb-chains", nb_chains,
+                 "optimize: number of parallel chains, 0 for one per "
+                 "hardware thread");
+  app.add_option("--replicas", annealing.nb_replicas,
+                 "anneal: number of replicas, each at its own temperature")
+      ->check(CLI::Range(1u, 1024u));
+  app.add_option("--anneal-steps", annealing.nb_steps,
+                 "anneal: number of moves tried by each replica");
+  app.add_option("--exchange-period", annealing.exchange_period,
+                 "anneal: number of moves between two replica exchanges")
+      ->check(CLI::Range(1u, 100000000u));
+  app.add_option("--anneal-schedule", schedule,
+                 "anneal: evolution of the temperatures during the run")
+      ->check(CLI::IsMember({"constant", "linear", "geometric"}));
+  app.add_option("--min-temperature", annealing.min_temperature,
+                 "anneal: temperature of the coldest replica, relative to "
+                 "the start sharpe")
+      ->check(CLI::Range(1e-12, 1e3));
+  app.add_option("--max-temperature", annealing.max_temperature,
+                 "anneal: temperature of the hottest replica, relative to "
+                 "the start sharpe")
+      ->check(CLI::Range(1e-12, 1e3));
+  app.add_option("--final-ratio", annealing.final_ratio,
+                 "anneal: ratio of the final temperatures to the start ones "
+                 "for the linear and geometric schedules")
+      ->check(CLI::Range(1e-12, 1.0));
+  app.add_flag("--log-acceptance", annealing.log_acceptance,
+               "anneal: log the acceptance rates per temperature");
+  app.add_option("--qp-iterations", qp.max_iterations,
+                 "qp, frontier: max number of projected gradient iterations "
+                 "of each solve")
+      ->check(CLI::Range(1u, 100000000u));
+  app.add_option("--qp-tolerance", qp.tolerance,
+                 "qp, frontier: stop a solve once an iteration would "
+                 "increase the sharpe by less than this ratio")
+      ->check(CLI::Range(0.0, 1.0));
+  app.add_option("--frontier-sizes", frontier_sizes,
+                 "frontier: range of the portfolio sizes, as a:b");
+  app.add_option("--frontier-caps", frontier.max_weights,
+                 "frontier: max parts of the capital in each asset, "
+                 "separated by commas")
+      ->delimiter(',')
+      ->check(CLI::Range(min_share_percent, 1.0));
+  app.add_flag("--prescreen", prescreen,
+               "compute-brute, beam, optimize, anneal, qp, frontier: remove "
+               "the assets dominated by more assets than the portfolio size "
+               "before the search");
+  app.add_option("-o,--output", output,
+                 "Where to save the ranked portfolios, or the frontier as "
+                 "JSON or as CSV if the path ends with .csv");
+  app.add_option("-i,--input", inputs,
+                 "merge: the ranked portfolios files to merge; optimize, "
+                 "anneal: start from the best portfolio of these ranked "
+                 "portfolios files, e.g. the one of qp, instead of the best "
+                 "portfolio");
 
   CLI11_PARSE(app, argc, argv);
 
+  if (!output.empty()) {
+    FinalPortfolio::ranked_portfolios_path = output;
+    FinalPortfolio::frontier_path = output;
+  }
+
+  if (mode == "check-kernels") {
+    // Synthetic data, to check the kernels offline
+    auto trucs = synthetic_trucs(check_nb_assets, check_seed);
+    if (!check_combinadic(12, true) || !check_sharpe_kernels(trucs, 1000, true))
+      return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+  } else if (mode == "merge") {
+    // Combine the results of several processes, only from their files
+    FinalPortfolio::merge_ranked_portfolios(inputs, nb_results);
+    return EXIT_SUCCESS;
+  }
+
+  if (username_opt->count() == 0 || password_opt->count() == 0) {
+    std::cerr << "The mode " << mode << " needs --username and --password\n";
+    return EXIT_FAILURE;
+  }
+
   // Create the JUMP API client
   auto client = JumpClient::build(std::move(username), std::move(password));
 
   // Load or fetch the pre-calculated data
   auto trucs = get_the_trucs_interessants(*client);
 
+  // The stochastic optimizer historically builds smaller portfolios
+  if (mode == "optimize" && portfolio_size_opt->count() == 0) {
+    portfolio_size = default_stochastic_portfolio_size;
+  }
+
+  if (!frontier_sizes.empty()) {
+    parse_size_range(frontier_sizes, frontier);
+  }
+
+  if (prescreen && (mode == "compute-brute" || mode == "beam" ||
+                    mode == "optimize" || mode == "anneal" || mode == "qp" ||
+                    mode == "frontier")) {
+    // The optimizers start from a portfolio, keep its assets
+    auto kept = std::vector<share_index_t>();
+    if (mode == "optimize" || mode == "anneal") {
+      for (const auto &[_nb_shares, i_asset] :
+           FinalPortfolio::start_compo(trucs, inputs)) {
+        kept.push_back(i_asset);
+      }
+    }
+    // An asset dominated for the largest size is dominated for every size
+    trucs = prescreen_assets(
+        trucs, mode == "frontier" ? frontier.max_size : portfolio_size, kept);
+  }
+
   if (mode == "check") {
     check_portfolio(trucs);
+  } else if (mode == "beam") {
+    // The width is at least the number of results, see `max_compo_beam`
+    auto width = std::max(beam_width, nb_results);
+    auto max_width = max_beam_width(trucs.assets_id.size());
+    if (width > max_width) {
+      std::cerr << "A beam width of " << width << " needs too much memory for "
+                << trucs.assets_id.size() << " assets, at most " << max_width
+                << '\n';
+      return EXIT_FAILURE;
+    }
+    auto results =
+        max_compo_beam(trucs, portfolio_size, beam_width, nb_results);
+    return save_results(trucs, results);
   } else if (mode == "optimize") {
-    optimize_portfolio(trucs, *client);
+    optimize_portfolio(trucs, *client,
+                       FinalPortfolio::start_compo(trucs, inputs),
+                       portfolio_size, nb_results, nb_chains);
+  } else if (mode == "anneal") {
+    if (schedule == "constant") {
+      annealing.schedule = AnnealingSchedule::constant;
+    } else if (schedule == "linear") {
+      annealing.schedule = AnnealingSchedule::linear;
+    }
+    auto results =
+        anneal_compo(trucs, FinalPortfolio::start_compo(trucs, inputs),
+                     annealing, nb_results);
+    return save_results(trucs, results);
+  } else if (mode == "qp") {
+    auto results = max_compo_qp(trucs, portfolio_size, qp, nb_results);
+    return save_results(trucs, results);
+  } else if (mode == "frontier") {
+    frontier.qp = qp;
+    FinalPortfolio::save_frontier(trucs, qp_frontier(trucs, frontier));
   } else if (mode == "optimize-hard") {
     optimize_hard(trucs, *client);
   } else if (mode == "push") {
@@ -403,15 +803,24 @@ int main(int argc, char *argv[]) {
   } else {
     // Try to create the best portfolio
     std::clog << "max_compo_tree\n";
-    auto [best_compo, best_sharpe] = max_compo_tree_multithread(trucs);
-
-    // Display the best portfolio found
-    std::cout << "\nBest portfolio found:\n";
-    std::cout << "Sharpe: " << best_sharpe << '\n';
-    std::cout << "List of (asset_id, bought_shares):\n";
-    for (const auto &[nb_shares, i_asset] : best_compo) {
-      std::cout << "- " << trucs.assets_id[i_asset] << "\t" << nb_shares
-                << '\n';
+    auto slice = TreeSlice();
+    if (!shard.empty()) {
+      parse_shard(shard, slice);
+    }
+    if (!rank_range.empty()) {
+      slice.rank_range = parse_rank_range(rank_range);
+    }
+
+    auto results = TopCompos(nb_results);
+    try {
+      results = max_compo_tree_multithread(
+          trucs, portfolio_size, nb_results, slice,
+          time_budget == 0 ? std::nullopt
+                           : std::optional(std::chrono::seconds(time_budget)));
+    } catch (const std::overflow_error &e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
     }
+    return save_results(trucs, results);
   }
 }
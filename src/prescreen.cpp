@@ -0,0 +1,149 @@
+#include "prescreen.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+/** Metrics of an asset for the same invested value */
+struct AssetMetrics {
+  double return_rate;
+  double variance;
+  double capital;
+};
+
+/** Whether swapping the asset `b` for the asset `a` in a portfolio with the
+ * same invested value cannot lower its sharpe: `a` has a higher return and
+ * capital, and a lower covariance with every asset. The equal assets are
+ * ordered by index so that they do not dominate each other.
+ */
+static bool dominates(const TrucsInteressants &trucs,
+                      const std::vector<AssetMetrics> &metrics, unsigned a,
+                      unsigned b) {
+  const auto &ma = metrics[a];
+  const auto &mb = metrics[b];
+  if (ma.return_rate < mb.return_rate || ma.variance > mb.variance ||
+      ma.capital < mb.capital)
+    return false;
+
+  // Only the covariances with the other assets of the portfolio matter
+  auto strict = ma.return_rate > mb.return_rate ||
+                ma.variance < mb.variance || ma.capital > mb.capital;
+  for (auto l = 0u; l < metrics.size(); ++l) {
+    if (l == a || l == b)
+      continue;
+
+    auto cov_a = trucs.cov_matrix(a, l);
+    auto cov_b = trucs.cov_matrix(b, l);
+    if (cov_a > cov_b)
+      return false;
+    strict |= cov_a < cov_b;
+  }
+  return strict || a < b;
+}
+
+/** Run `f(i)` for every asset on the work pool */
+template <typename F> static void for_each_asset(unsigned nb_assets, F &&f) {
+  auto tasks = std::vector<unsigned>(nb_assets);
+  std::iota(tasks.begin(), tasks.end(), 0);
+
+  auto pool = WorkStealingPool<unsigned>();
+  pool.run(std::move(tasks), [&f](unsigned &&i, unsigned) { f(i); });
+}
+
+std::vector<share_index_t> dominated_assets(const TrucsInteressants &trucs,
+                                            unsigned portfolio_size) {
+  auto nb_assets = (unsigned)trucs.start_values.size();
+
+  // The covariances are the ones of the returns, they are already given for
+  // the same invested value
+  auto metrics = std::vector<AssetMetrics>(nb_assets);
+  for (auto i = 0u; i < nb_assets; ++i) {
+    metrics[i] = AssetMetrics{
+        trucs.end_values[i] / trucs.start_values[i] - 1,
+        trucs.cov_matrix(i, i),
+        trucs.assets_capital[i],
+    };
+  }
+
+  // The covariance rows are only compared for the pairs that pass the checks
+  // of the metrics, so the pass is close to O(N^2)
+  auto is_dominated = std::vector<char>(nb_assets, false);
+  for_each_asset(nb_assets, [&](unsigned i) {
+    auto nb_dominators = 0u;
+    for (auto j = 0u; j < nb_assets && nb_dominators < portfolio_size; ++j) {
+      if (j != i && dominates(trucs, metrics, j, i)) {
+        ++nb_dominators;
+      }
+    }
+    is_dominated[i] = nb_dominators >= portfolio_size;
+  });
+
+  auto dominated = std::vector<share_index_t>();
+  for (auto i = 0u; i < nb_assets; ++i) {
+    if (is_dominated[i]) {
+      dominated.push_back(i);
+    }
+  }
+  return dominated;
+}
+
+TrucsInteressants select_assets(const TrucsInteressants &trucs,
+                                const std::vector<share_index_t> &assets) {
+  auto selected = TrucsInteressants();
+  selected.cov_matrix = finmath::covariance_matrix_t(assets.size());
+
+  for (auto i = 0u; i < assets.size(); ++i) {
+    auto asset = assets[i];
+    selected.start_values.push_back(trucs.start_values[asset]);
+    selected.end_values.push_back(trucs.end_values[asset]);
+    selected.nb_shares.push_back(trucs.nb_shares[asset]);
+    selected.assets_id.push_back(trucs.assets_id[asset]);
+    selected.assets_capital.push_back(trucs.assets_capital[asset]);
+
+    for (auto j = i; j < assets.size(); ++j) {
+      selected.cov_matrix(i, j) = trucs.cov_matrix(asset, assets[j]);
+      selected.cov_matrix(j, i) = selected.cov_matrix(i, j);
+    }
+  }
+  return selected;
+}
+
+/** log10 of the number of compositions of k assets among n */
+static double log10_nb_compos(unsigned n, unsigned k) {
+  if (k > n)
+    return -INFINITY;
+  return (std::lgamma(n + 1.0) - std::lgamma(k + 1.0) -
+          std::lgamma(n - k + 1.0)) /
+         std::log(10.0);
+}
+
+TrucsInteressants prescreen_assets(const TrucsInteressants &trucs,
+                                   unsigned portfolio_size,
+                                   const std::vector<share_index_t> &kept) {
+  auto nb_assets = (unsigned)trucs.start_values.size();
+  auto dominated = dominated_assets(trucs, portfolio_size);
+
+  auto is_removed = std::vector<char>(nb_assets, false);
+  for (auto asset : dominated) {
+    is_removed[asset] = true;
+  }
+  for (auto asset : kept) {
+    is_removed[asset] = false;
+  }
+
+  auto assets = std::vector<share_index_t>();
+  for (auto i = 0u; i < nb_assets; ++i) {
+    if (!is_removed[i]) {
+      assets.push_back(i);
+    }
+  }
+
+  std::clog << "Pre-screening kept " << assets.size() << " of " << nb_assets
+            << " assets, the compositions of " << portfolio_size
+            << " assets go from 10^"
+            << log10_nb_compos(nb_assets, portfolio_size) << " to 10^"
+            << log10_nb_compos(assets.size(), portfolio_size) << '\n';
+  return select_assets(trucs, assets);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "tree.hpp"
+
+#include <vector>
+
+/** Get the assets dominated by at least `portfolio_size` other assets.
+ * An asset dominates another one when, for the same invested value, it has a
+ * higher return, a lower variance, a lower covariance with every other asset,
+ * and a higher capital so that it can take the same part of the portfolio.
+ * A portfolio containing a dominated asset can swap it for one of its
+ * dominators that is not in the portfolio yet, without lowering its sharpe
+ * but for the rounding of the numbers of shares.
+ */
+std::vector<share_index_t> dominated_assets(const TrucsInteressants &trucs,
+                                            unsigned portfolio_size);
+
+/** Get the trucs of the given assets only, in the same order */
+TrucsInteressants select_assets(const TrucsInteressants &trucs,
+                                const std::vector<share_index_t> &assets);
+
+/** Remove the dominated assets, except the `kept` ones, and report how much
+ * the search space of `portfolio_size` assets shrinks */
+TrucsInteressants prescreen_assets(const TrucsInteressants &trucs,
+                                   unsigned portfolio_size,
+                                   const std::vector<share_index_t> &kept = {});
@@ -0,0 +1,556 @@
+#include "qp.hpp"
+#include "quadform.hpp"
+#include "stochastic.hpp"
+#include "swaps.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <tuple>
+
+/** Sufficient increase of the sharpe of a whole step over the lowest sharpe
+ * of the last `nonmonotone_memory` iterations, relative to its first order
+ * estimate */
+constexpr double armijo_ratio = 1e-4;
+constexpr unsigned nonmonotone_memory = 10;
+
+/** Number of bisections of the projection on the weights, enough to reach
+ * the precision of the doubles */
+constexpr unsigned projection_bisections = 64;
+
+/** Maximum number of changes of shares to repair the %NAV rule after the
+ * rounding */
+constexpr unsigned max_repair_moves = 1000;
+
+/** Continuous max sharpe problem on some assets: their weights are within
+ * [min_weight, max_weight] and sum to 1 */
+struct QpProblem {
+  /** Covariances of the assets, packed by `pack_submatrix` */
+  std::vector<double> cov;
+  std::size_t stride;
+
+  /** Return of each asset for the same invested value */
+  std::vector<double> returns;
+
+  double min_weight;
+  double max_weight;
+
+  std::size_t size() const { return returns.size(); }
+};
+
+/** Weights of the assets of a problem, with their sharpe and its gradient */
+struct QpPoint {
+  std::vector<double> weights;
+
+  /** `cov * weights` */
+  std::vector<double> cov_w;
+
+  /** Return and variance of the portfolio for a capital of 1 */
+  double ret;
+  double variance;
+
+  sharpe_t sharpe;
+  std::vector<double> gradient;
+};
+
+static QpProblem make_problem(const TrucsInteressants &trucs,
+                              std::span<const share_index_t> assets,
+                              double min_weight, double max_weight) {
+  auto problem = QpProblem();
+  finmath::pack_submatrix(trucs.cov_matrix, assets, problem.cov);
+  problem.stride = finmath::packed_stride(assets.size());
+  for (auto i_asset : assets) {
+    problem.returns.push_back(trucs.end_values[i_asset] /
+                                  trucs.start_values[i_asset] -
+                              1);
+  }
+  problem.min_weight = min_weight;
+  problem.max_weight = max_weight;
+  return problem;
+}
+
+/** Compute `cov * x`, the only O(N^2) operation of an iteration */
+static void multiply_cov(const QpProblem &problem, std::span<const double> x,
+                         std::vector<double> &cov_x) {
+  auto n = problem.size();
+  cov_x.resize(n);
+  for (auto i = 0u; i < n; ++i) {
+    // Independent partial sums, so that the additions are pipelined
+    const auto *row = problem.cov.data() + i * problem.stride;
+    auto sums = std::array<double, 4>();
+    auto j = 0u;
+    for (; j + 4 <= n; j += 4) {
+      for (auto k = 0u; k < 4; ++k) {
+        sums[k] += row[j + k] * x[j + k];
+      }
+    }
+    for (; j < n; ++j) {
+      sums[0] += row[j] * x[j];
+    }
+    cov_x[i] = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+  }
+}
+
+/** Sharpe of a portfolio of a capital of 1 */
+static sharpe_t qp_sharpe(double ret, double variance) {
+  return finmath::sharpe(finmath::PortfolioSums{1, 1 + ret, variance});
+}
+
+/** Compute the sharpe of the point and its gradient from its weights and
+ * `cov_w`, in O(N). The sharpe is `m / sqrt(v)` where `m = r^T * w` is the
+ * return and `v = w^T * cov * w` the variance, so its gradient is
+ * `r / sqrt(v) - m * cov * w / v^(3/2)`.
+ */
+static void update_sharpe(const QpProblem &problem, QpPoint &point) {
+  auto n = problem.size();
+  point.ret = 0;
+  point.variance = 0;
+  for (auto i = 0u; i < n; ++i) {
+    point.ret += problem.returns[i] * point.weights[i];
+    point.variance += point.weights[i] * point.cov_w[i];
+  }
+  point.sharpe = qp_sharpe(point.ret, point.variance);
+
+  // Same regularization of the volatility as `finmath::sharpe`
+  auto deviation =
+      std::max(std::sqrt(point.variance), std::numeric_limits<double>::min());
+  auto volatility = deviation + 1e-8;
+  auto cov_factor = point.ret / (deviation * volatility * volatility);
+  point.gradient.resize(n);
+  for (auto i = 0u; i < n; ++i) {
+    point.gradient[i] =
+        problem.returns[i] / volatility - cov_factor * point.cov_w[i];
+  }
+}
+
+sharpe_t qp_sharpe_gradient(const TrucsInteressants &trucs,
+                            std::span<const share_index_t> assets,
+                            std::span<const double> weights,
+                            std::vector<double> &gradient) {
+  auto problem = make_problem(trucs, assets, 0, 1);
+  auto point = QpPoint();
+  point.weights.assign(weights.begin(), weights.end());
+  multiply_cov(problem, point.weights, point.cov_w);
+  update_sharpe(problem, point);
+  gradient = std::move(point.gradient);
+  return point.sharpe;
+}
+
+/** Project `target` on the weights of the problem: the projection is
+ * `clamp(target - tau, min_weight, max_weight)`, where the sum decreases
+ * with tau, so tau is found by bisection */
+static void project(const QpProblem &problem, std::span<const double> target,
+                    std::vector<double> &weights) {
+  auto clamped_sum = [&](double tau) {
+    double sum = 0;
+    for (auto value : target) {
+      sum += std::clamp(value - tau, problem.min_weight, problem.max_weight);
+    }
+    return sum;
+  };
+
+  // Every weight is at its max below `low` and at its min above `high`
+  auto [min_it, max_it] = std::minmax_element(target.begin(), target.end());
+  auto low = *min_it - problem.max_weight;
+  auto high = *max_it - problem.min_weight;
+  for (auto _i = 0u; _i < projection_bisections; ++_i) {
+    auto mid = low + (high - low) / 2;
+    (clamped_sum(mid) > 1 ? low : high) = mid;
+  }
+
+  weights.resize(target.size());
+  for (auto i = 0u; i < target.size(); ++i) {
+    weights[i] =
+        std::clamp(target[i] - high, problem.min_weight, problem.max_weight);
+  }
+}
+
+/** Maximize the sharpe of the problem by a spectral projected gradient
+ * ascent from the projection of `start`. The direction d of an iteration
+ * goes to the projection of a Barzilai-Borwein step of the gradient, and is
+ * taken whole unless the sharpe falls below the ones of the last iterations.
+ * Otherwise, the sharpe along d is `(m + b * t) / sqrt(v + 2 * g * t + s *
+ * t^2)` like in `best_step`, and the best t in [0, 1] is found in closed form.
+ * Either way, `cov * d` updates `cov * w` without another product.
+ */
+static QpPoint solve(const QpProblem &problem, std::span<const double> start,
+                     const QpParams &params, unsigned &nb_iterations) {
+  auto n = problem.size();
+  auto point = QpPoint();
+  project(problem, start, point.weights);
+  multiply_cov(problem, point.weights, point.cov_w);
+  update_sharpe(problem, point);
+  auto best_weights = point.weights;
+  auto best_sharpe = point.sharpe;
+
+  // First step moving the weights by about the max weight
+  double max_gradient = 0;
+  for (auto g : point.gradient) {
+    max_gradient = std::max(max_gradient, std::abs(g));
+  }
+  auto step = max_gradient > 0 ? problem.max_weight / max_gradient : 1;
+
+  auto recent_sharpes = std::array<sharpe_t, nonmonotone_memory>();
+  recent_sharpes.fill(point.sharpe);
+  auto target = std::vector<double>(n);
+  auto direction = std::vector<double>(n);
+  auto cov_d = std::vector<double>(n);
+  auto previous_gradient = std::vector<double>(n);
+  for (nb_iterations = 0; nb_iterations < params.max_iterations;
+       ++nb_iterations) {
+    for (auto i = 0u; i < n; ++i) {
+      target[i] = point.weights[i] + step * point.gradient[i];
+    }
+    project(problem, target, direction);
+
+    // The first order increase vanishes at a stationary point
+    double increase = 0;
+    for (auto i = 0u; i < n; ++i) {
+      direction[i] -= point.weights[i];
+      increase += point.gradient[i] * direction[i];
+    }
+    if (increase <= params.tolerance * std::abs(point.sharpe))
+      break;
+
+    multiply_cov(problem, direction, cov_d);
+    double b = 0;
+    double g = 0;
+    double s = 0;
+    for (auto i = 0u; i < n; ++i) {
+      b += problem.returns[i] * direction[i];
+      g += point.cov_w[i] * direction[i];
+      s += direction[i] * cov_d[i];
+    }
+
+    auto a = point.ret;
+    auto v = point.variance;
+    auto t = 1.0;
+    auto reference =
+        *std::min_element(recent_sharpes.begin(), recent_sharpes.end());
+    if (qp_sharpe(a + b, v + 2 * g + s) < reference + armijo_ratio * increase) {
+      auto denominator = b * g - a * s;
+      if (denominator != 0) {
+        t = std::clamp((a * g - b * v) / denominator, 0.0, 1.0);
+      }
+      if (qp_sharpe(a + b * t, v + t * (2 * g + t * s)) <= point.sharpe)
+        break;
+    }
+
+    std::swap(previous_gradient, point.gradient);
+    for (auto i = 0u; i < n; ++i) {
+      point.weights[i] += t * direction[i];
+      point.cov_w[i] += t * cov_d[i];
+    }
+    update_sharpe(problem, point);
+    recent_sharpes[nb_iterations % nonmonotone_memory] = point.sharpe;
+    if (point.sharpe > best_sharpe) {
+      best_sharpe = point.sharpe;
+      best_weights = point.weights;
+    }
+
+    // Barzilai-Borwein step `s^T s / |s^T y|`, with s the change of the
+    // weights and y the one of the gradient
+    double ss = 0;
+    double sy = 0;
+    for (auto i = 0u; i < n; ++i) {
+      ss += t * direction[i] * t * direction[i];
+      sy += t * direction[i] * (point.gradient[i] - previous_gradient[i]);
+    }
+    step = sy < 0 ? ss / -sy : 2 * step;
+  }
+
+  // Exact `cov * w` of the best weights, without the rounding errors of the
+  // updates
+  point.weights = std::move(best_weights);
+  multiply_cov(problem, point.weights, point.cov_w);
+  update_sharpe(problem, point);
+  return point;
+}
+
+/** Change the shares of the extreme assets until the composition respects
+ * the %NAV rule with the max weight `max_weight`: an asset below the min gets
+ * the shares it lacks, or the largest asset gives up capital when it has no
+ * more shares, and an asset above the max gives up its extra shares.
+ * \return whether the composition respects the rule
+ */
+template <unsigned K>
+static bool repair_compo(SharpeCache<K> &cache, double max_weight) {
+  const auto &trucs = cache.trucs;
+  const auto &compo = cache.compo;
+  const auto &bounds = cache.bounds;
+  auto respects_rule = [&]() {
+    return bounds.min >= min_share_percent * cache.start_capital &&
+           bounds.max <= max_weight * cache.start_capital;
+  };
+
+  for (auto _i = 0u; _i < max_repair_moves && !respects_rule(); ++_i) {
+    auto capital = cache.start_capital;
+    auto i_compo = bounds.i_max;
+    double buy_value;
+    if (bounds.min < min_share_percent * capital) {
+      // Buy value of the smallest asset reaching the min with the new capital
+      auto i_min = bounds.i_min;
+      buy_value =
+          min_share_percent * (capital - bounds.min) / (1 - min_share_percent);
+      auto i_asset = compo.assets()[i_min];
+      if (compo.shares()[i_min] < trucs.nb_shares[i_asset]) {
+        auto nb_shares =
+            std::min<double>(std::ceil(buy_value / trucs.start_values[i_asset]),
+                             trucs.nb_shares[i_asset]);
+        recompute_sharpe(cache, i_min,
+                         (int)nb_shares - (int)compo.shares()[i_min], true);
+        continue;
+      }
+
+      // Lower the capital to the one where the smallest asset is at the min
+      buy_value = bounds.max - (capital - bounds.min / min_share_percent);
+    } else {
+      buy_value = max_weight * (capital - bounds.max) / (1 - max_weight);
+    }
+
+    auto i_asset = compo.assets()[i_compo];
+    auto nb_shares = std::max(
+        1.0, std::floor(buy_value / trucs.start_values[i_asset]));
+    auto dshares = (int)nb_shares - (int)compo.shares()[i_compo];
+    if (dshares == 0)
+      return false;
+    recompute_sharpe(cache, i_compo, dshares, true);
+  }
+  return respects_rule();
+}
+
+/** Round the weights of the `assets` to numbers of shares with the largest
+ * capital their available shares allow, then repair them with the max weight
+ * `max_weight`
+ * \return the cache of the composition, nothing if it cannot be repaired
+ */
+template <unsigned K>
+static std::optional<SharpeCache<K>>
+round_weights(const TrucsInteressants &trucs,
+              std::span<const share_index_t> assets,
+              std::span<const double> weights, double max_weight) {
+  double capital = INFINITY;
+  for (auto i = 0u; i < K; ++i) {
+    capital = std::min(capital, trucs.assets_capital[assets[i]] / weights[i]);
+  }
+
+  auto compo = finmath::FixedComposition<K>();
+  for (auto i = 0u; i < K; ++i) {
+    auto i_asset = assets[i];
+    auto start_value = trucs.start_values[i_asset];
+    auto nb_shares = std::clamp<double>(
+        std::round(weights[i] * capital / start_value), 1,
+        trucs.nb_shares[i_asset]);
+    compo.set_asset(i, i_asset, nb_shares, start_value);
+  }
+
+  auto cache = SharpeCache<K>(trucs);
+  compute_sharpe_init_chache(compo, cache);
+  if (!repair_compo(cache, max_weight))
+    return std::nullopt;
+  return cache;
+}
+
+/** Composition of the cache and its sharpe computed from exact sums, without
+ * the rounding errors of the incremental updates */
+template <unsigned K>
+static std::tuple<compo_t, sharpe_t> exact_compo(SharpeCache<K> &cache) {
+  auto sharpe = compute_sharpe_init_chache(
+      finmath::FixedComposition<K>(cache.compo), cache);
+  return std::make_tuple(cache.compo.investments(), sharpe);
+}
+
+/** Solve the problem on every asset with the weights in [0, max_weight],
+ * from equal weights */
+static QpPoint solve_relaxation(const TrucsInteressants &trucs,
+                                double max_weight, const QpParams &params,
+                                unsigned &nb_iterations) {
+  auto nb_assets = trucs.start_values.size();
+  auto all_assets = std::vector<share_index_t>(nb_assets);
+  std::iota(all_assets.begin(), all_assets.end(), 0);
+  return solve(make_problem(trucs, all_assets, 0, max_weight),
+               std::vector<double>(nb_assets, 1.0 / nb_assets), params,
+               nb_iterations);
+}
+
+/** The `portfolio_size` assets of largest weights in the relaxation, then of
+ * largest gradient to fill the portfolio if its support is smaller */
+static std::vector<share_index_t> largest_weights(const QpPoint &relaxed,
+                                                  unsigned portfolio_size) {
+  const auto &w = relaxed.weights;
+  const auto &g = relaxed.gradient;
+  auto order = std::vector<share_index_t>(w.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::partial_sort(order.begin(), order.begin() + portfolio_size,
+                    order.end(), [&](auto a, auto b) {
+                      return w[a] != w[b] ? w[a] > w[b] : g[a] > g[b];
+                    });
+  order.resize(portfolio_size);
+  return order;
+}
+
+TopCompos max_compo_qp(const TrucsInteressants &trucs,
+                       unsigned portfolio_size, const QpParams &params,
+                       unsigned nb_results) {
+  auto results = TopCompos(nb_results);
+  if (trucs.start_values.size() < portfolio_size)
+    return results;
+
+  auto nb_iterations = 0u;
+  auto relaxed =
+      solve_relaxation(trucs, max_share_percent, params, nb_iterations);
+  auto support = std::count_if(relaxed.weights.begin(), relaxed.weights.end(),
+                               [](double w) { return w > 0; });
+  std::clog << "QP relaxation: sharpe " << relaxed.sharpe << " with "
+            << support << " assets after " << nb_iterations
+            << " iterations\n";
+
+  auto assets = largest_weights(relaxed, portfolio_size);
+  auto start = std::vector<double>();
+  for (auto i_asset : assets) {
+    start.push_back(relaxed.weights[i_asset]);
+  }
+  auto point = solve(
+      make_problem(trucs, assets, min_share_percent, max_share_percent),
+      start, params, nb_iterations);
+  std::clog << "QP on " << portfolio_size << " assets: sharpe "
+            << point.sharpe << " after " << nb_iterations << " iterations\n";
+
+  auto repaired = dispatch_portfolio_size(portfolio_size, [&]<unsigned K>() {
+    auto cache =
+        round_weights<K>(trucs, assets, point.weights, max_share_percent);
+    if (!cache)
+      return false;
+
+    std::clog << "Rounded sharpe: " << cache_sharpe(*cache) << '\n';
+    steepest_ascent(*cache, max_ascent_moves);
+
+    // The other results are the best swaps of the composition, polished
+    if (nb_results > 1) {
+      auto pool = WorkStealingPool<unsigned>();
+      for (const auto &swap : best_swaps(*cache, nb_results - 1, pool)) {
+        auto neighbour = *cache;
+        swap_asset(neighbour, swap.i_compo, swap.i_asset, swap.nb_shares,
+                   true);
+        steepest_ascent(neighbour, max_ascent_moves);
+        auto [compo, sharpe] = exact_compo(neighbour);
+        results.push(sharpe, compo);
+      }
+    }
+
+    auto [compo, sharpe] = exact_compo(*cache);
+    results.push(sharpe, compo);
+    return true;
+  });
+  if (!repaired) {
+    std::clog << "The %NAV rule could not be repaired after the rounding\n";
+  }
+  return results;
+}
+
+/** Contiguous sizes [first, last) of the frontier of a max weight, given as
+ * indices from the min size, swept by one task */
+struct FrontierChunk {
+  unsigned i_cap = 0;
+  unsigned first = 0;
+  unsigned last = 0;
+};
+
+std::vector<FrontierPoint> qp_frontier(const TrucsInteressants &trucs,
+                                       const FrontierParams &params) {
+  const auto &max_weights = params.max_weights;
+  auto nb_sizes = params.max_size - params.min_size + 1;
+  auto nb_assets = (unsigned)trucs.start_values.size();
+  auto points = std::vector<FrontierPoint>();
+  for (auto max_weight : max_weights) {
+    for (auto size = params.min_size; size <= params.max_size; ++size) {
+      auto &point = points.emplace_back();
+      point.portfolio_size = size;
+      point.max_weight = max_weight;
+    }
+  }
+
+  // The relaxation does not depend on the size: solve it once for each max
+  // weight
+  auto relaxations = std::vector<std::optional<QpPoint>>(max_weights.size());
+  auto caps = std::vector<unsigned>(max_weights.size());
+  std::iota(caps.begin(), caps.end(), 0);
+  auto relaxation_pool = WorkStealingPool<unsigned>(
+      std::min<unsigned>(caps.size(), std::thread::hardware_concurrency()));
+  relaxation_pool.run(std::move(caps), [&](unsigned &&i_cap, unsigned) {
+    auto max_weight = max_weights[i_cap];
+    if (nb_assets * max_weight < 1)
+      return;
+
+    auto nb_iterations = 0u;
+    relaxations[i_cap] =
+        solve_relaxation(trucs, max_weight, params.qp, nb_iterations);
+  });
+
+  // Split the sizes of each max weight in contiguous chunks, so that the
+  // cores are used even for a single max weight
+  auto pool = WorkStealingPool<FrontierChunk>();
+  auto nb_chunks = std::min(
+      nb_sizes, (pool.nb_workers() + (unsigned)max_weights.size() - 1) /
+                    (unsigned)max_weights.size());
+  auto chunks = std::vector<FrontierChunk>();
+  for (auto i_cap = 0u; i_cap < max_weights.size(); ++i_cap) {
+    if (!relaxations[i_cap])
+      continue;
+    for (auto i_chunk = 0u; i_chunk < nb_chunks; ++i_chunk) {
+      chunks.push_back(FrontierChunk{i_cap, i_chunk * nb_sizes / nb_chunks,
+                                     (i_chunk + 1) * nb_sizes / nb_chunks});
+    }
+  }
+
+  pool.run(std::move(chunks), [&](FrontierChunk &&chunk, unsigned) {
+    auto max_weight = max_weights[chunk.i_cap];
+    const auto &relaxed = *relaxations[chunk.i_cap];
+
+    // Each size starts from the weights of the previous one of the chunk, so
+    // that it only adds an asset to its active set. The added asset, and the
+    // first size of the chunk, start from the weights of the relaxation.
+    auto warm_weights = relaxed.weights;
+    for (auto i_size = chunk.first; i_size < chunk.last; ++i_size) {
+      auto &point = points[chunk.i_cap * nb_sizes + i_size];
+      auto size = point.portfolio_size;
+      point.relaxed_sharpe = relaxed.sharpe;
+      if (size > nb_assets || size * max_weight < 1 ||
+          max_weight < min_share_percent)
+        continue;
+
+      auto assets = largest_weights(relaxed, size);
+      auto start = std::vector<double>();
+      for (auto i_asset : assets) {
+        start.push_back(warm_weights[i_asset]);
+      }
+      auto solved =
+          solve(make_problem(trucs, assets, min_share_percent, max_weight),
+                start, params.qp, point.nb_iterations);
+      point.sharpe = solved.sharpe;
+      for (auto i = 0u; i < size; ++i) {
+        warm_weights[assets[i]] = solved.weights[i];
+      }
+
+      auto rounded = dispatch_portfolio_size(
+          size,
+          [&]<unsigned K>() -> std::optional<std::tuple<compo_t, sharpe_t>> {
+            auto cache =
+                round_weights<K>(trucs, assets, solved.weights, max_weight);
+            if (!cache)
+              return std::nullopt;
+            return exact_compo(*cache);
+          });
+      if (rounded) {
+        std::tie(point.compo, point.rounded_sharpe) = *rounded;
+      }
+    }
+  });
+  return points;
+}
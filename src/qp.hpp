@@ -0,0 +1,86 @@
+#pragma once
+
+#include "top_compos.hpp"
+#include "tree.hpp"
+
+#include <span>
+#include <vector>
+
+struct QpParams {
+  /** Maximum number of projected gradient iterations of each solve */
+  unsigned max_iterations = 10000;
+
+  /** A solve stops once the first order increase of the sharpe by an
+   * iteration is below this ratio of the sharpe */
+  double tolerance = 1e-10;
+};
+
+/** Find a composition of `portfolio_size` assets from the continuous max
+ * sharpe problem, where the weights are the parts of the capital in each
+ * asset, summing to 1.
+ * The problem is first solved on every asset with the weights in
+ * [0, max_share_percent] by a projected gradient ascent, which finds the
+ * global optimum since the sharpe is pseudo-concave where it is positive.
+ * The `portfolio_size` assets of largest weights are then solved again with
+ * the weights in [min_share_percent, max_share_percent]. The weights are
+ * rounded to numbers of shares with the largest capital the available shares
+ * allow, the %NAV rule is repaired, and the shares are polished by a
+ * `steepest_ascent`. The other results are the `nb_results - 1` best swaps
+ * of `best_swaps` of this composition, each polished the same way.
+ * \return the compositions found, none if the rounding cannot be repaired
+ */
+TopCompos max_compo_qp(const TrucsInteressants &trucs,
+                       unsigned portfolio_size, const QpParams &params,
+                       unsigned nb_results);
+
+/** Sharpe of the `weights` of the `assets`, the parts of the capital in each
+ * asset, and its `gradient`, computed like the projected gradient ascent of
+ * `max_compo_qp`, to check them against the reference */
+sharpe_t qp_sharpe_gradient(const TrucsInteressants &trucs,
+                            std::span<const share_index_t> assets,
+                            std::span<const double> weights,
+                            std::vector<double> &gradient);
+
+/** Sizes of the portfolios and max weights of their assets of the frontier */
+struct FrontierParams {
+  unsigned min_size = min_portfolio_size;
+  unsigned max_size = max_portfolio_size;
+
+  /** Max part of the capital in each asset, `max_share_percent` for the %NAV
+   * rule */
+  std::vector<double> max_weights = {max_share_percent};
+
+  QpParams qp;
+};
+
+/** Best sharpe of the portfolios of a size and a max weight */
+struct FrontierPoint {
+  unsigned portfolio_size;
+  double max_weight;
+
+  /** Sharpe of the continuous problem on every asset, and on the
+   * `portfolio_size` assets chosen from it, -inf when the weights cannot sum
+   * to 1 */
+  sharpe_t relaxed_sharpe = -INFINITY;
+  sharpe_t sharpe = -INFINITY;
+  unsigned nb_iterations = 0;
+
+  /** Composition rounded from the weights within the max weight, empty if
+   * the rounding could not be repaired */
+  compo_t compo;
+  sharpe_t rounded_sharpe = -INFINITY;
+};
+
+/** Solve the continuous problem of `max_compo_qp` for every portfolio size
+ * and max weight of the parameters, in the order of the max weights then of
+ * the sizes.
+ * The relaxation on every asset only depends on the max weight, so it is
+ * solved once for each one, the max weights running in parallel. The sizes
+ * of each max weight are then split in contiguous chunks running in
+ * parallel, each chunk sweeping its sizes in increasing order with each
+ * solve starting from the weights of the previous size. The weights are
+ * rounded and repaired like in `max_compo_qp`, without the `steepest_ascent`
+ * which only knows the %NAV rule.
+ */
+std::vector<FrontierPoint> qp_frontier(const TrucsInteressants &trucs,
+                                       const FrontierParams &params);
@@ -0,0 +1,164 @@
+#include "quadform.hpp"
+
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define QUADFORM_X86
+#include <immintrin.h>
+#endif
+
+namespace finmath {
+namespace {
+/** Quadratic form gathering the covariances from the matrix rows */
+using gather_kernel_t = double (*)(const double *data, std::size_t stride,
+                                   const unsigned *indices,
+                                   const double *weights, std::size_t size);
+
+double gather_scalar(const double *data, std::size_t stride,
+                     const unsigned *indices, const double *weights,
+                     std::size_t size) {
+  double total = 0;
+  for (auto i = 0u; i < size; ++i) {
+    const auto *row = data + indices[i] * stride;
+
+    double inner = 0;
+    for (auto j = 0u; j < size; ++j) {
+      inner += weights[j] * row[indices[j]];
+    }
+    total += weights[i] * inner;
+  }
+  return total;
+}
+
+#ifdef QUADFORM_X86
+__attribute__((target("avx2,fma"))) double hsum_avx2(__m256d v) {
+  auto low = _mm256_castpd256_pd128(v);
+  auto high = _mm256_extractf128_pd(v, 1);
+  low = _mm_add_pd(low, high);
+  high = _mm_unpackhi_pd(low, low);
+  return _mm_cvtsd_f64(_mm_add_sd(low, high));
+}
+
+__attribute__((target("avx2,fma"))) double
+gather_avx2(const double *data, std::size_t stride, const unsigned *indices,
+            const double *weights, std::size_t size) {
+  auto all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+  double total = 0;
+  for (auto i = 0u; i < size; ++i) {
+    const auto *row = data + indices[i] * stride;
+
+    auto acc = _mm256_setzero_pd();
+    auto j = 0u;
+    for (; j + 4 <= size; j += 4) {
+      auto vindex =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + j));
+      auto cov = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), row, vindex,
+                                          all_lanes, sizeof(double));
+      acc = _mm256_fmadd_pd(cov, _mm256_loadu_pd(weights + j), acc);
+    }
+
+    auto inner = hsum_avx2(acc);
+    for (; j < size; ++j) {
+      inner += weights[j] * row[indices[j]];
+    }
+    total += weights[i] * inner;
+  }
+  return total;
+}
+
+__attribute__((target("avx512f"))) double hsum_avx512(__m512d v) {
+  alignas(64) double lanes[8];
+  _mm512_store_pd(lanes, v);
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+         ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+__attribute__((target("avx512f"))) double
+gather_avx512(const double *data, std::size_t stride, const unsigned *indices,
+              const double *weights, std::size_t size) {
+  double total = 0;
+  for (auto i = 0u; i < size; ++i) {
+    const auto *row = data + indices[i] * stride;
+
+    auto acc = _mm512_setzero_pd();
+    auto j = 0u;
+    for (; j + 8 <= size; j += 8) {
+      auto vindex =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + j));
+      auto cov = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, vindex,
+                                          row, sizeof(double));
+      acc = _mm512_fmadd_pd(cov, _mm512_loadu_pd(weights + j), acc);
+    }
+
+    auto inner = hsum_avx512(acc);
+    for (; j < size; ++j) {
+      inner += weights[j] * row[indices[j]];
+    }
+    total += weights[i] * inner;
+  }
+  return total;
+}
+
+#endif
+
+struct Kernels {
+  std::string_view name;
+  gather_kernel_t gather;
+};
+
+Kernels select_kernels() {
+#ifdef QUADFORM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return {"avx512", gather_avx512};
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return {"avx2", gather_avx2};
+#endif
+  return {"scalar", gather_scalar};
+}
+
+/** The kernels of the current CPU, selected on the first call */
+const Kernels &kernels() {
+  static const auto selected = select_kernels();
+  return selected;
+}
+} // namespace
+
+double quadratic_form(const CovarianceMatrix &cov_matrix,
+                      std::span<const unsigned> indices,
+                      std::span<const double> weights) {
+  assert(indices.size() == weights.size());
+  return kernels().gather(cov_matrix.data(), cov_matrix.stride(),
+                          indices.data(), weights.data(), indices.size());
+}
+
+std::size_t packed_stride(std::size_t size) {
+  // Keep each row on its own cache lines
+  return (size + 7) / 8 * 8;
+}
+
+void pack_submatrix(const CovarianceMatrix &cov_matrix,
+                    std::span<const unsigned> indices,
+                    std::vector<double> &packed) {
+  auto stride = packed_stride(indices.size());
+  packed.assign(indices.size() * stride, 0);
+
+  for (auto i = 0u; i < indices.size(); ++i) {
+    for (auto j = 0u; j < indices.size(); ++j) {
+      packed[i * stride + j] = cov_matrix(indices[i], indices[j]);
+    }
+  }
+}
+
+std::string_view quadratic_form_kernel() { return kernels().name; }
+
+namespace scalar {
+double quadratic_form(const CovarianceMatrix &cov_matrix,
+                      std::span<const unsigned> indices,
+                      std::span<const double> weights) {
+  return gather_scalar(cov_matrix.data(), cov_matrix.stride(), indices.data(),
+                       weights.data(), indices.size());
+}
+} // namespace scalar
+} // namespace finmath
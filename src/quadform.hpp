@@ -0,0 +1,37 @@
+#pragma once
+
+#include "covariance_matrix.hpp"
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace finmath {
+/** Compute the quadratic form `w^T * cov[S][S] * w` where S are the
+ * `indices` of the assets and w their `weights`.
+ * The covariances are gathered from the rows of the matrix.
+ */
+double quadratic_form(const CovarianceMatrix &cov_matrix,
+                      std::span<const unsigned> indices,
+                      std::span<const double> weights);
+
+/** Copy the sub-matrix `cov[S][S]` where S are the `indices` of the assets
+ * into `packed`, with rows of `packed_stride(indices.size())` values */
+void pack_submatrix(const CovarianceMatrix &cov_matrix,
+                    std::span<const unsigned> indices,
+                    std::vector<double> &packed);
+
+/** Distance between two rows of a packed sub-matrix of `size` assets */
+std::size_t packed_stride(std::size_t size);
+
+/** Name of the kernels selected for the current CPU */
+std::string_view quadratic_form_kernel();
+
+namespace scalar {
+/** Reference implementations, used when the CPU has no supported SIMD
+ * extension */
+double quadratic_form(const CovarianceMatrix &cov_matrix,
+                      std::span<const unsigned> indices,
+                      std::span<const double> weights);
+} // namespace scalar
+} // namespace finmath
@@ -0,0 +1,18 @@
+#include "random.hpp"
+
+ZigguratTables::ZigguratTables() {
+  auto f = std::exp(-0.5 * tail_start * tail_start);
+  x[0] = layer_area / f;
+  x[1] = tail_start;
+  x[nb_layers] = 0;
+  for (auto i = 2u; i < nb_layers; ++i) {
+    x[i] = std::sqrt(-2 * std::log(layer_area / x[i - 1] + f));
+    f = std::exp(-0.5 * x[i] * x[i]);
+  }
+
+  for (auto i = 0u; i < nb_layers; ++i) {
+    ratio[i] = x[i + 1] / x[i];
+  }
+}
+
+const ZigguratTables ziggurat_tables;
@@ -445,8 +445,7 @@ IMPL_GETTER3(finmath::covariance_matrix_t, covariance_matrix) {
 
   auto asset_size = (*assets)["2016-06-01"].size();
 
-  auto cov_matrix = finmath::covariance_matrix_t();
-  cov_matrix.reserve(asset_size);
+  auto cov_matrix = finmath::covariance_matrix_t(asset_size);
 
   // get volatilities
   auto ratios = std::vector<int32_t>();
@@ -475,7 +474,7 @@ IMPL_GETTER3(finmath::covariance_matrix_t, covariance_matrix) {
 
   // correlation
   for (auto i_asset = 0u; i_asset < asset_size; ++i_asset) {
-    auto &cov_vec = cov_matrix.emplace_back();
+    auto cov_vec = cov_matrix.row(i_asset);
     double var_i = vars[i_asset];
 
     if (verbose) {
@@ -502,18 +501,64 @@ IMPL_GETTER3(finmath::covariance_matrix_t, covariance_matrix) {
         std::replace(vol_str_j.begin(), vol_str_j.end(), ',', '.');
         vol_j = std::stod(vol_str_j);
       } catch (std::exception &e) {
-        cov_vec.emplace_back(0);
         continue;
       }
 
       double result = correlation * std::sqrt(vol_i * vol_j);
 
-      cov_vec.emplace_back(result);
+      cov_vec[j_asset] = result;
     }
   }
   return cov_matrix;
 }
-IMPL_METHOD3(finmath::covariance_matrix_t, covariance_matrix)
+
+/** Whether the binary save exists and is at least as recent as the json save
+ * it was made from, or the json save is missing */
+static bool binary_save_is_fresh(const std::filesystem::path &bin_path,
+                                 const std::filesystem::path &json_path) {
+  auto error = std::error_code();
+  auto bin_time = std::filesystem::last_write_time(bin_path, error);
+  if (error)
+    return false;
+
+  auto json_time = std::filesystem::last_write_time(json_path, error);
+  return error || bin_time >= json_time;
+}
+
+finmath::covariance_matrix_t SaveData::covariance_matrix(
+    std::optional<SaveData::DaysAssets> &assets,
+    std::optional<finmath::days_currency_rates_t> &rates, JumpClient &client,
+    bool verbose) {
+  static auto root = std::filesystem::current_path() / "data";
+  constexpr std::string_view bin_fname = "covariance_matrix.bin";
+  constexpr std::string_view fname = "covariance_matrix.json";
+
+  // Try to load the binary save, much faster to load than the json one, but
+  // only if it is not older than the json one
+  if (binary_save_is_fresh(root / bin_fname, root / fname)) {
+    auto f = std::ifstream(root / bin_fname, std::ios::binary);
+    if (f.good()) {
+      auto cov_matrix = finmath::CovarianceMatrix::load_binary(f);
+      if (cov_matrix.has_value())
+        return std::move(*cov_matrix);
+    }
+  }
+
+  auto getter = [&assets, &rates, &client, verbose]() {
+    return covariance_matrix_getter(assets, rates, client, verbose);
+  };
+  auto cov_matrix =
+      load_or_download<finmath::covariance_matrix_t>(fname, getter);
+
+  auto f = std::ofstream(root / bin_fname, std::ios::binary);
+  if (f.good()) {
+    cov_matrix.save_binary(f);
+  } else {
+    std::cerr << "Could not save to " << root / bin_fname << "\n";
+  }
+
+  return cov_matrix;
+}
 
 IMPL_GETTER(finmath::days_currency_rates_t, days_currency_rates) {
   using namespace date;
@@ -0,0 +1,44 @@
+#include "sharpe.hpp"
+
+namespace finmath {
+PortfolioSums portfolio_sums(const CovarianceMatrix &cov_matrix,
+                             const assets_day_values_t &end_values,
+                             const Composition &compo) {
+  return PortfolioSums{
+      compo.start_capital(), compo.end_capital(end_values),
+      quadratic_form(cov_matrix, compo.assets(), compo.buy_values())};
+}
+
+PortfolioSums portfolio_sums(const CovarianceMatrix &cov_matrix,
+                             const assets_day_values_t &start_values,
+                             const assets_day_values_t &end_values,
+                             const investments_t &investments) {
+  return portfolio_sums(cov_matrix, end_values,
+                        Composition(investments, start_values));
+}
+
+namespace reference {
+PortfolioSums portfolio_sums(const CovarianceMatrix &cov_matrix,
+                             const assets_day_values_t &start_values,
+                             const assets_day_values_t &end_values,
+                             const investments_t &investments) {
+  long double start_capital = 0;
+  long double end_capital = 0;
+  long double variance = 0;
+
+  for (const auto &[nb_shares1, i_asset1] : investments) {
+    start_capital += (long double)nb_shares1 * start_values[i_asset1];
+    end_capital += (long double)nb_shares1 * end_values[i_asset1];
+
+    for (const auto &[nb_shares2, i_asset2] : investments) {
+      variance += (long double)nb_shares1 * start_values[i_asset1] *
+                  nb_shares2 * start_values[i_asset2] *
+                  cov_matrix(i_asset1, i_asset2);
+    }
+  }
+
+  return PortfolioSums{(double)start_capital, (double)end_capital,
+                       (double)variance};
+}
+} // namespace reference
+} // namespace finmath
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "composition.hpp"
+#include "finmath.hpp"
+#include "quadform.hpp"
+
+#include <cmath>
+#include <span>
+
+namespace finmath {
+/** Sums describing a portfolio, enough to compute its sharpe */
+struct PortfolioSums {
+  /** Capital invested at the start of the period */
+  double start_capital = 0;
+
+  /** Value of the portfolio at the end of the period */
+  double end_capital = 0;
+
+  /** Quadratic form `b^T * cov * b` where b are the buy values */
+  double variance = 0;
+};
+
+/** Volatility of the portfolio, relative to its start capital */
+inline double volatility(const PortfolioSums &sums) {
+  return std::sqrt(sums.variance) / sums.start_capital;
+}
+
+/** Sharpe of the portfolio, the value maximized by every solver.
+ * Its numerator is the return of the portfolio, so a solver can bound it by
+ * `(end_capital - start_capital) / sqrt(variance)` when it is positive.
+ */
+inline double sharpe(const PortfolioSums &sums) {
+  return (sums.end_capital / sums.start_capital - 1) /
+         (volatility(sums) + 1e-8);
+}
+
+/** Compute the sums of a composition from its cached buy values */
+PortfolioSums portfolio_sums(const CovarianceMatrix &cov_matrix,
+                             const assets_day_values_t &end_values,
+                             const Composition &compo);
+
+/** Compute the sums of a fixed size composition */
+template <unsigned K>
+PortfolioSums portfolio_sums(const CovarianceMatrix &cov_matrix,
+                             const assets_day_values_t &end_values,
+                             const FixedComposition<K> &compo) {
+  return PortfolioSums{
+      compo.start_capital(), compo.end_capital(end_values),
+      quadratic_form(cov_matrix, compo.assets(), compo.buy_values())};
+}
+
+/** Compute the sums of a portfolio */
+PortfolioSums portfolio_sums(const CovarianceMatrix &cov_matrix,
+                             const assets_day_values_t &start_values,
+                             const assets_day_values_t &end_values,
+                             const investments_t &investments);
+
+namespace reference {
+/** Slow but straightforward version of `finmath::portfolio_sums`, used to
+ * check the optimized kernels */
+PortfolioSums portfolio_sums(const CovarianceMatrix &cov_matrix,
+                             const assets_day_values_t &start_values,
+                             const assets_day_values_t &end_values,
+                             const investments_t &investments);
+} // namespace reference
+} // namespace finmath
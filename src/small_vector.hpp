@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+
+/** Vector of trivially copyable values, stored inline up to N values and on
+ * the heap after that. Avoids an allocation per composition in the solvers.
+ */
+template <typename T, std::size_t N> class SmallVector {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  SmallVector() = default;
+
+  SmallVector(const SmallVector &other) { *this = other; }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this != &other) {
+      resize(other.size_);
+      std::copy_n(other.data(), other.size_, data());
+    }
+    return *this;
+  }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::size_t capacity() const { return heap_ ? capacity_ : N; }
+
+  T *data() { return heap_ ? heap_.get() : inline_; }
+  const T *data() const { return heap_ ? heap_.get() : inline_; }
+
+  T &operator[](std::size_t i) { return data()[i]; }
+  const T &operator[](std::size_t i) const { return data()[i]; }
+
+  T *begin() { return data(); }
+  T *end() { return data() + size_; }
+  const T *begin() const { return data(); }
+  const T *end() const { return data() + size_; }
+
+  operator std::span<T>() { return {data(), size_}; }
+  operator std::span<const T>() const { return {data(), size_}; }
+
+  void reserve(std::size_t capacity) {
+    if (capacity <= this->capacity())
+      return;
+
+    auto heap = std::unique_ptr<T[]>(new T[capacity]);
+    std::copy_n(data(), size_, heap.get());
+    heap_ = std::move(heap);
+    capacity_ = capacity;
+  }
+
+  /** Resize without initializing the new values */
+  void resize(std::size_t size) {
+    if (size > capacity())
+      reserve(std::max(size, 2 * capacity()));
+    size_ = size;
+  }
+
+  void push_back(T value) {
+    resize(size_ + 1);
+    data()[size_ - 1] = value;
+  }
+
+  void clear() { size_ = 0; }
+
+private:
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+  T inline_[N];
+  std::unique_ptr<T[]> heap_;
+};
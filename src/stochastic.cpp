@@ -1,269 +1,136 @@
 #include "stochastic.hpp"
 #include "check.hpp"
+#include "quadform.hpp"
+#include "swaps.hpp"
 
+#include <atomic>
+#include <condition_variable>
 #include <csignal>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <random>
+#include <sstream>
+#include <thread>
 
 namespace {
-volatile bool abort_process = false;
+std::atomic<bool> abort_process = false;
 }
 
 void signal_handler(int) { abort_process = true; }
 
-static double comp_vol(const SharpeCache &cache) {
-  double vol = 0;
-  for (auto i = 0u; i < cache.compo.size(); ++i) {
-    auto asset1 = std::get<1>(cache.compo[i]);
-    const auto &cov_vec = cache.trucs.cov_matrix[asset1];
-
-    double subvol = cache.buy_values[i] * cov_vec[asset1];
-    for (auto j = i + 1; j < cache.compo.size(); ++j) {
-      auto asset2 = std::get<1>(cache.compo[j]);
-
-      subvol += 2 * cache.buy_values[j] * cov_vec[asset2];
+void fill_proposals(MoveProposals &proposals, unsigned portfolio_size,
+                    unsigned nb_assets) {
+  auto &gen = proposals.gen;
+  for (auto &move : proposals.block) {
+    move.i_compo = uniform_index(gen, portfolio_size);
+    if (uniform_unit(gen) < swap_probability) {
+      move.new_asset = uniform_index(gen, nb_assets);
+      continue;
     }
-    vol += (cache.buy_values[i] / cache.start_capital) * subvol;
-  }
-
-  return vol / cache.start_capital;
-}
-
-sharpe_t compute_sharpe_init_chache(const TrucsInteressants &trucs,
-                                    const compo_t &compo, SharpeCache &cache) {
-  // Initialize the vectors
-  auto compo_size = compo.size();
-  cache.buy_values.resize(0);
-  cache.buy_values.reserve(compo_size);
-
-  // Set the start values & capital
-  cache.start_capital = 0;
-  for (const auto &[nb_shares, i_asset] : compo) {
-    cache.start_capital += cache.buy_values.emplace_back(
-        (double)nb_shares * trucs.start_values[i_asset]);
-  }
-
-  // Set the end values & capital
-  cache.end_capital = 0;
-  for (const auto &[nb_shares, i_asset] : compo) {
-    cache.end_capital += (double)nb_shares * trucs.end_values[i_asset];
-  }
-
-  double vol = comp_vol(cache);
-
-  // Compute the sharpe
-  return (cache.end_capital / cache.start_capital) / vol;
-}
-
-sharpe_t recompute_sharpe(SharpeCache &cache, unsigned i_compo_changed,
-                          double dshares, bool only_update_cache) {
-  auto &[shares, i_asset] = cache.compo[i_compo_changed];
-  shares += (unsigned)dshares;
-
-  // Initialize the vectors
-  auto compo_size = cache.compo.size();
-  cache.buy_values.resize(0);
-  cache.buy_values.reserve(compo_size);
-
-  // Set the start values & capital
-  cache.start_capital = 0;
-  for (const auto &[nb_shares, i_asset] : cache.compo) {
-    cache.start_capital += cache.buy_values.emplace_back(
-        (double)nb_shares * cache.trucs.start_values[i_asset]);
-  }
 
-  // Set the end values & capital
-  cache.end_capital = 0;
-  for (const auto &[nb_shares, i_asset] : cache.compo) {
-    cache.end_capital += (double)nb_shares * cache.trucs.end_values[i_asset];
+    // Round the normal step away from 0 instead of rejecting the null ones
+    move.new_asset = no_swap;
+    auto dx = dshares_deviation * normal_ziggurat(gen);
+    move.dshares = dx < 0 ? -1 - (int)-dx : 1 + (int)dx;
   }
-
-  // Update start & end capital
-  auto dbuy_value = (double)dshares * cache.trucs.start_values[i_asset];
-  cache.buy_values[i_compo_changed] += dbuy_value;
-  cache.start_capital += dbuy_value;
-
-  cache.end_capital += dshares * cache.trucs.end_values[i_asset];
-
-  if (only_update_cache || !check_compo_cache(cache))
-    return -INFINITY;
-
-  double vol = comp_vol(cache);
-
-  // Compute the sharpe
-  return (cache.end_capital / cache.start_capital) / vol;
+  proposals.next = 0;
 }
 
-bool check_compo_cache(const SharpeCache &cache) {
-  // Verify the %NAV
-  for (auto buy_value : cache.buy_values) {
-    auto true_ratio = buy_value / cache.start_capital;
-    if (true_ratio < min_share_percent || true_ratio > max_share_percent) {
-      return false;
-    }
+/** Maximum number of swaps of assets of a local search */
+constexpr unsigned max_swap_moves = 1000;
+
+template <unsigned K>
+static std::tuple<compo_t, sharpe_t>
+optimize_compo_stochastic(const TrucsInteressants &trucs,
+                          const compo_t &start_compo,
+                          WorkStealingPool<unsigned> &pool) {
+  auto cache = SharpeCache<K>(trucs);
+  compute_sharpe_init_chache(
+      finmath::FixedComposition<K>(start_compo, trucs.start_values), cache);
+  auto sharpe = steepest_ascent(cache, max_ascent_moves);
+
+  // The ascent does not change the assets: apply the best swap while it
+  // improves the sharpe, and optimize the shares again after each one
+  for (auto _i = 0u; _i < max_swap_moves; ++_i) {
+    auto swaps = best_swaps(cache, 1, pool);
+    if (swaps.empty() || swaps[0].sharpe <= sharpe)
+      break;
+
+    const auto &swap = swaps[0];
+    swap_asset(cache, swap.i_compo, swap.i_asset, swap.nb_shares, true);
+    sharpe = steepest_ascent(cache, max_ascent_moves);
   }
 
-  // TODO: Check stock proportion
-  return true;
+  // Return exact sums, without the rounding errors of the incremental
+  // updates
+  auto best_sharpe = compute_sharpe_init_chache(
+      finmath::FixedComposition<K>(cache.compo), cache);
+  return std::make_tuple(cache.compo.investments(), best_sharpe);
 }
 
 std::tuple<compo_t, sharpe_t>
-optimize_compo_stochastic(const TrucsInteressants &trucs, compo_t compo) {
-  constexpr auto n_iter = 5000u;
-
-  std::random_device rd;
-  std::mt19937 gen(rd());
-
-  auto cache = SharpeCache(trucs, compo);
-  auto best_sharpe = compute_sharpe_init_chache(trucs, compo, cache);
-  // best_sharpe = get_sharpe(compo);
-
-  auto dshare = std::normal_distribution<double>(0, 1);
-  auto dasset = std::uniform_int_distribution<unsigned>(0, compo.size() - 1);
-  auto best_compo = compo;
-  for (auto _i = 0u; _i < n_iter; ++_i) {
-    int dx;
-    do {
-      dx = 50 * dshare(gen);
-    } while (dx == 0);
-
-    share_index_t i = dasset(gen);
-
-    // Clamp the share modifier to be in bound
-    auto &[shares, i_asset] = compo[i];
-    dx = std::max<int>(-shares + 1, dx);
-    dx = std::min<int>(dx, trucs.nb_shares[i_asset] - shares);
-
-    auto sharpe_opt = recompute_sharpe(cache, i, dx, false);
-    // std::cout << sharpe_opt << " --- " << best_sharpe << '\n';
-    // Set best sharpe if better sharpe and still valid
-    if (sharpe_opt > 0 && sharpe_opt > best_sharpe) {
-      best_sharpe = sharpe_opt;
-      best_compo = compo;
-    } else {
-      // Undo action
-      recompute_sharpe(cache, i, -dx, true);
-      compo = best_compo;
-    }
-  }
+optimize_compo_stochastic(const TrucsInteressants &trucs,
+                          const compo_t &start_compo,
+                          WorkStealingPool<unsigned> &pool) {
+  return dispatch_portfolio_size(start_compo.size(), [&]<unsigned K>() {
+    return optimize_compo_stochastic<K>(trucs, start_compo, pool);
+  });
+}
 
-  auto go_one_way = [&cache, &best_sharpe](auto i, auto step,
-                                           auto &found_better) -> bool {
-    auto &[shares, i_asset] = cache.compo[i];
-    // shares += step;
+template <unsigned K>
+static std::tuple<compo_t, sharpe_t>
+optimize_compo_2(const TrucsInteressants &trucs, const compo_t &start_compo,
+                 sharpe_t sharpe,
+                 std::function<double(const compo_t &)> &get_sharpe,
+                 bool quick) {
+  auto cache = SharpeCache<K>(trucs);
+  compute_sharpe_init_chache(
+      finmath::FixedComposition<K>(start_compo, trucs.start_values), cache);
 
-    auto out_of_bounds =
-        shares + step < 1 || shares + step >= cache.trucs.nb_shares[i_asset];
-    if (out_of_bounds || check_compo_cache(cache)) {
-      shares -= step;
-      return false;
+  auto best_sharpe = sharpe;
+  auto rejected = std::array<bool, K>();
+  for (auto nb_calls = 0u; !quick || nb_calls < K; ++nb_calls) {
+    // Try the best move of the local model that `get_sharpe` did not reject
+    // since the last improvement
+    auto moves = evaluate_single_moves(cache);
+    auto i_best = K;
+    for (auto i = 0u; i < K; ++i) {
+      if (!rejected[i] && moves[i].dshares != 0 &&
+          (i_best == K || moves[i].sharpe > moves[i_best].sharpe)) {
+        i_best = i;
+      }
     }
+    if (i_best == K)
+      break;
 
-    auto sharpe = recompute_sharpe(cache, i, step, false);
+    recompute_sharpe(cache, i_best, moves[i_best].dshares, true);
+    auto sharpe = get_sharpe(cache.compo.investments());
     if (sharpe > best_sharpe) {
       best_sharpe = sharpe;
-      found_better = true;
-      return true;
-    } else {
-      shares -= step;
-      return false;
-    }
-  };
-
-  best_sharpe = compute_sharpe_init_chache(trucs, best_compo, cache);
-
-  // Optimize with a big step
-  constexpr int step1 = 10;
-  bool found_better;
-  do {
-    found_better = false;
+      rejected.fill(false);
 
-    for (auto i = 0u; i < compo.size(); ++i) {
-      // Test one way
-      while (go_one_way(i, step1, found_better)) {
-      }
-
-      // Test the other way
-      while (go_one_way(i, -step1, found_better)) {
-      }
+      // One write so that the lines of the chains are not interleaved
+      auto line = std::ostringstream();
+      line << "Best sharpe (steepest ascent): " << best_sharpe << '\n';
+      std::cout << line.str();
+    } else {
+      undo_change(cache);
+      rejected[i_best] = true;
     }
-  } while (found_better);
+  }
 
-  return std::make_tuple(best_compo, best_sharpe);
+  return std::make_tuple(cache.compo.investments(), best_sharpe);
 }
 
 std::tuple<compo_t, sharpe_t>
 optimize_compo_2(const TrucsInteressants &trucs, compo_t compo, sharpe_t sharpe,
                  std::function<double(const compo_t &)> get_sharpe,
                  bool quick) {
-  auto best_sharpe = sharpe;
-
-  auto go_one_way = [&compo, &trucs, &get_sharpe, &best_sharpe](
-                        auto i, auto step, auto &found_better) -> bool {
-    auto &[shares, i_asset] = compo[i];
-    shares += step;
-
-    auto out_of_bounds = shares < 1 || shares >= trucs.nb_shares[i_asset];
-    if (out_of_bounds || !check_compo(trucs, compo, false)) {
-      shares -= step;
-      return false;
-    }
-
-    auto sharpe = get_sharpe(compo);
-    if (sharpe > best_sharpe) {
-      best_sharpe = sharpe;
-      found_better = true;
-      return true;
-    } else {
-      shares -= step;
-      return false;
-    }
-  };
-
-  auto opti_step = [&best_sharpe, &compo,
-                    &go_one_way](std::string_view name,
-                                 std::function<unsigned(unsigned)> get_step) {
-    bool found_better;
-    do {
-      found_better = false;
-      std::cout << "Best sharpe (" << name << "): " << best_sharpe << '\n';
-
-      for (auto i = 0u; i < compo.size(); ++i) {
-        auto step = get_step(i);
-
-        bool found_better1 = false;
-        // Test one way
-        while (go_one_way(i, step, found_better1)) {
-        }
-
-        if (!found_better) {
-          // Test the other way
-          while (go_one_way(i, -step, found_better1)) {
-          }
-        }
-
-        found_better |= found_better1;
-      }
-    } while (found_better);
-  };
-
-  // Optimize with a big dynamic step
-  opti_step("ratio=0.1", [&trucs, &compo](auto i) -> unsigned {
-    return std::max<unsigned>(1, 0.5 * min_share_percent *
-                                     trucs.nb_shares[std::get<1>(compo[i])]);
+  return dispatch_portfolio_size(compo.size(), [&]<unsigned K>() {
+    return optimize_compo_2<K>(trucs, compo, sharpe, get_sharpe, quick);
   });
-
-  if (quick) {
-    return std::make_tuple(compo, best_sharpe);
-  }
-
-  // Optimize with a big fixed step
-  opti_step("step=10", [](auto) -> unsigned { return 10; });
-
-  // Optimize with a small fixed step
-  opti_step("step=1", [](auto) -> unsigned { return 1; });
-
-  return std::make_tuple(compo, best_sharpe);
 }
 
 static void swap_low_capital_ratio(const TrucsInteressants &trucs,
@@ -322,9 +189,140 @@ static void swap_low_capital_ratio(const TrucsInteressants &trucs,
   }
 }
 
-compo_t
+/** Serializes the calls to `get_sharpe`, whose JUMP client session is not
+ * thread-safe: the chains push their compositions in the queue and wait,
+ * while the thread running `serve` evaluates them one at a time.
+ */
+class SharpeQueue {
+public:
+  explicit SharpeQueue(std::function<double(const compo_t &)> get_sharpe)
+      : get_sharpe_(std::move(get_sharpe)) {}
+
+  /** Evaluate the composition on the serving thread */
+  double operator()(const compo_t &compo) {
+    auto request = Request{&compo, std::promise<double>()};
+    auto sharpe = request.sharpe.get_future();
+    {
+      auto lock = std::lock_guard(mutex_);
+      requests_.push_back(std::move(request));
+    }
+    cv_.notify_one();
+    return sharpe.get();
+  }
+
+  /** Evaluate the queued compositions until `done` and the queue is empty */
+  void serve(const std::function<bool()> &done) {
+    auto lock = std::unique_lock(mutex_);
+    while (true) {
+      cv_.wait_for(lock, std::chrono::milliseconds(100),
+                   [this] { return !requests_.empty(); });
+      if (requests_.empty()) {
+        if (done())
+          return;
+        continue;
+      }
+
+      auto request = std::move(requests_.front());
+      requests_.pop_front();
+      lock.unlock();
+      try {
+        request.sharpe.set_value(get_sharpe_(*request.compo));
+      } catch (...) {
+        request.sharpe.set_exception(std::current_exception());
+      }
+      lock.lock();
+    }
+  }
+
+private:
+  struct Request {
+    const compo_t *compo;
+    std::promise<double> sharpe;
+  };
+
+  std::function<double(const compo_t &)> get_sharpe_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Request> requests_;
+};
+
+/** Best composition found by the chains of `find_best_compo_stochastic` */
+struct StochasticShared {
+  std::mutex mutex;
+  compo_t best_compo;
+  sharpe_t best_sharpe;
+};
+
+/** Number of restarts of a chain between two restarts from the best
+ * composition of every chain */
+constexpr unsigned restarts_per_sync = 8;
+
+/** Restart the chain from its best composition with random assets swapped
+ * until the process is interrupted, publishing its improvements. Its swaps
+ * are scored on `nb_workers` threads, and its valid compositions kept in its
+ * own `results`. */
+static void run_stochastic_chain(const TrucsInteressants &trucs,
+                                 StochasticShared &shared,
+                                 SharpeQueue &get_sharpe, TopCompos &results,
+                                 unsigned seed, unsigned nb_workers) {
+  constexpr auto min_sharpe_can_opti = 2.0;
+
+  std::mt19937 gen(seed);
+  auto assets_selected = std::vector<bool>();
+  auto pool = WorkStealingPool<unsigned>(nb_workers);
+
+  compo_t best_compo;
+  sharpe_t best_sharpe;
+  {
+    auto lock = std::lock_guard(shared.mutex);
+    best_compo = shared.best_compo;
+    best_sharpe = shared.best_sharpe;
+  }
+
+  for (auto i_restart = 1u; !abort_process; ++i_restart) {
+    // Swap those with low capital ratios with random ones
+    auto compo = best_compo;
+    swap_low_capital_ratio(trucs, compo, gen, assets_selected);
+
+    auto [new_compo, new_sharpe] =
+        optimize_compo_stochastic(trucs, compo, pool);
+    new_sharpe = get_sharpe(new_compo);
+    if (new_sharpe > min_sharpe_can_opti) {
+      std::tie(new_compo, new_sharpe) =
+          optimize_compo_2(trucs, new_compo, new_sharpe, std::ref(get_sharpe),
+                           true);
+    }
+
+    if (new_sharpe > best_sharpe) {
+      best_compo = new_compo;
+      best_sharpe = new_sharpe;
+    }
+
+    if (check_compo(trucs, new_compo, false)) {
+      results.push(new_sharpe, new_compo);
+    }
+
+    auto lock = std::lock_guard(shared.mutex);
+    std::clog << new_sharpe << ' ' << shared.best_sharpe << '\n';
+    if (new_sharpe > shared.best_sharpe) {
+      std::clog << "New best compute sharpe: " << new_sharpe << '\n';
+      check_compo(trucs, shared.best_compo, true);
+      shared.best_compo = std::move(new_compo);
+      shared.best_sharpe = new_sharpe;
+    } else if (i_restart % restarts_per_sync == 0 &&
+               shared.best_sharpe > best_sharpe) {
+      // Restart from the best composition of every chain
+      best_compo = shared.best_compo;
+      best_sharpe = shared.best_sharpe;
+    }
+  }
+}
+
+TopCompos
 find_best_compo_stochastic(const TrucsInteressants &trucs, compo_t compo,
-                           std::function<double(const compo_t &)> get_sharpe) {
+                           std::function<double(const compo_t &)> get_sharpe,
+                           unsigned portfolio_size, unsigned nb_results,
+                           unsigned nb_chains) {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGABRT, signal_handler);
 
@@ -332,10 +330,26 @@ find_best_compo_stochastic(const TrucsInteressants &trucs, compo_t compo,
   std::mt19937 gen(rd());
   auto assets_selected = std::vector<bool>();
 
-  auto WANTED_PORTFOLIO_SIZE = 20u;
-  WANTED_PORTFOLIO_SIZE =
-      std::min<unsigned>(trucs.assets_id.size() - 1, WANTED_PORTFOLIO_SIZE);
-  compo.resize(WANTED_PORTFOLIO_SIZE);
+  // Every asset of the composition must be swappable with an unused one
+  if (portfolio_size < min_portfolio_size ||
+      portfolio_size > max_portfolio_size)
+    throw std::out_of_range("Unsupported portfolio size");
+  if (trucs.assets_id.size() <= portfolio_size)
+    throw std::invalid_argument("Not enough assets for the portfolio size");
+
+  // Complete a smaller composition with distinct unused assets
+  if (compo.size() > portfolio_size)
+    compo.resize(portfolio_size);
+  assets_selected.assign(trucs.assets_id.size(), false);
+  for (const auto &[_nb_shares, i_asset] : compo) {
+    assets_selected[i_asset] = true;
+  }
+  for (auto i_asset = 0u; compo.size() < portfolio_size; ++i_asset) {
+    if (!assets_selected[i_asset]) {
+      assets_selected[i_asset] = true;
+      compo.emplace_back(0, i_asset);
+    }
+  }
 
   swap_low_capital_ratio(trucs, compo, gen, assets_selected, true);
 
@@ -354,35 +368,50 @@ find_best_compo_stochastic(const TrucsInteressants &trucs, compo_t compo,
 
   constexpr auto min_sharpe_can_opti = 2.0;
 
-  auto [best_compo, best_sharpe] = optimize_compo_stochastic(trucs, compo);
-  best_sharpe = get_sharpe(compo);
+  auto pool = WorkStealingPool<unsigned>();
+  auto [best_compo, best_sharpe] =
+      optimize_compo_stochastic(trucs, compo, pool);
+  best_sharpe = get_sharpe(best_compo);
   if (best_sharpe > min_sharpe_can_opti) {
     std::tie(best_compo, best_sharpe) =
         optimize_compo_2(trucs, best_compo, best_sharpe, get_sharpe, true);
   }
 
-  std::clog << "Start compute sharpe: " << best_sharpe << '\n';
-  while (!abort_process) {
-    // Swap those with low capital ratios with random ones
-    compo = best_compo;
-    swap_low_capital_ratio(trucs, compo, gen, assets_selected);
+  auto shared = StochasticShared{{}, best_compo, best_sharpe};
+  auto results = TopCompos(nb_results);
+  results.push(best_sharpe, best_compo);
 
-    auto [new_compo, new_sharpe] = optimize_compo_stochastic(trucs, compo);
-    new_sharpe = get_sharpe(new_compo);
-    if (new_sharpe > min_sharpe_can_opti) {
-      std::tie(new_compo, new_sharpe) =
-          optimize_compo_2(trucs, new_compo, new_sharpe, get_sharpe, true);
-    }
+  if (nb_chains == 0) {
+    nb_chains = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::clog << "Start compute sharpe: " << best_sharpe << " with "
+            << nb_chains << " chains\n";
+
+  // Share the remaining threads between the swap scorers of the chains
+  auto nb_workers =
+      std::max(1u, std::thread::hardware_concurrency() / nb_chains);
+
+  // The chains only use the JUMP client through the queue, served here
+  auto queue = SharpeQueue(std::move(get_sharpe));
+  auto nb_running = std::atomic<unsigned>(nb_chains);
+  auto chains = std::vector<std::thread>();
+  auto chain_results = std::vector<TopCompos>(nb_chains, TopCompos(nb_results));
+  for (auto i = 0u; i < nb_chains; ++i) {
+    chains.emplace_back([&, i, seed = rd()] {
+      run_stochastic_chain(trucs, shared, queue, chain_results[i], seed,
+                           nb_workers);
+      --nb_running;
+    });
+  }
 
-    std::clog << new_sharpe << ' ' << best_sharpe << '\n';
-    if (new_sharpe > best_sharpe) {
-      std::clog << "New best compute sharpe: " << new_sharpe << '\n';
-      check_compo(trucs, best_compo, true);
-      best_compo = new_compo;
-      best_sharpe = new_sharpe;
-    }
+  queue.serve([&nb_running] { return nb_running == 0; });
+  for (auto &chain : chains) {
+    chain.join();
+  }
+  for (const auto &chain : chain_results) {
+    results.merge(chain);
   }
 
-  std::clog << "Final compute sharpe: " << best_sharpe << '\n';
-  return best_compo;
+  std::clog << "Final compute sharpe: " << shared.best_sharpe << '\n';
+  return results;
 }
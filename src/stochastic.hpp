@@ -1,47 +1,607 @@
 #pragma once
 
 #include "jump/client.hpp"
+#include "random.hpp"
 #include "tree.hpp"
+#include "work_pool.hpp"
 
-struct SharpeCache {
+#include <algorithm>
+#include <limits>
+#include <optional>
+
+/** Size of the compositions built by `find_best_compo_stochastic` when no
+ * size is requested */
+constexpr unsigned default_stochastic_portfolio_size = 20;
+
+/** Smallest and largest buy values of a composition */
+struct BuyValueBounds {
+  double min;
+  double max;
+  unsigned i_min;
+  unsigned i_max;
+};
+
+/** State of a `SharpeCache` before a change, to undo it exactly in O(1) */
+struct SharpeCacheUndo {
+  unsigned i_compo;
+  share_index_t i_asset;
+  nb_shares_t nb_shares;
+  double start_capital;
+  double end_capital;
+  double variance;
+  unsigned i_cov_w;
+  BuyValueBounds bounds;
+};
+
+/** Composition of K assets being optimized, with its capitals and the terms
+ * of its variance, so that a change of one asset is evaluated in O(K) */
+template <unsigned K> struct SharpeCache {
   const TrucsInteressants &trucs;
-  compo_t &compo;
+
+  /** The composition being optimized, with the buy value of each asset */
+  finmath::FixedComposition<K> compo;
 
   double start_capital;
   double end_capital;
 
-  finmath::asset_period_values_t buy_values;
+  /** `w^T * cov * w` where w are the buy values */
+  double variance;
+
+  /** `cov * w` before and after the last change, `cov_w()` is the current
+   * one. A change writes the other buffer, so undoing it only switches back.
+   */
+  std::array<std::array<double, K>, 2> cov_w_buffers;
+  unsigned i_cov_w;
+
+  /** Extreme buy values, to check the %NAV rule in O(1) */
+  BuyValueBounds bounds;
 
-  SharpeCache(const TrucsInteressants &trucs_, compo_t &compo_)
-      : trucs(trucs_), compo(compo_), start_capital(), end_capital(),
-        buy_values() {}
+  /** State before the last change */
+  SharpeCacheUndo undo;
+
+  SharpeCache(const TrucsInteressants &trucs_)
+      : trucs(trucs_), compo(), start_capital(), end_capital(), variance(),
+        cov_w_buffers(), i_cov_w(), bounds(), undo() {}
+
+  /** `cov * w`: covariance of each asset with the whole portfolio */
+  const std::array<double, K> &cov_w() const {
+    return cov_w_buffers[i_cov_w];
+  }
 };
 
+/** Extreme buy values of the composition, except the one at `i_skip` */
+template <unsigned K>
+BuyValueBounds scan_buy_value_bounds(const finmath::FixedComposition<K> &compo,
+                                     unsigned i_skip = K) {
+  auto bounds = BuyValueBounds{INFINITY, -INFINITY, 0, 0};
+  auto buy_values = compo.buy_values();
+  for (auto i = 0u; i < K; ++i) {
+    if (i == i_skip)
+      continue;
+    if (buy_values[i] < bounds.min) {
+      bounds.min = buy_values[i];
+      bounds.i_min = i;
+    }
+    if (buy_values[i] > bounds.max) {
+      bounds.max = buy_values[i];
+      bounds.i_max = i;
+    }
+  }
+  return bounds;
+}
+
+/** Update the extreme buy values after the asset at `i_compo` changed. Only
+ * an extreme moving inwards needs a new scan. */
+template <unsigned K>
+void update_buy_value_bounds(SharpeCache<K> &cache, unsigned i_compo) {
+  auto &bounds = cache.bounds;
+  auto buy_value = cache.compo.buy_values()[i_compo];
+  if ((i_compo == bounds.i_min && buy_value > bounds.min) ||
+      (i_compo == bounds.i_max && buy_value < bounds.max)) {
+    bounds = scan_buy_value_bounds(cache.compo);
+    return;
+  }
+
+  if (buy_value < bounds.min) {
+    bounds.min = buy_value;
+    bounds.i_min = i_compo;
+  }
+  if (buy_value > bounds.max) {
+    bounds.max = buy_value;
+    bounds.i_max = i_compo;
+  }
+}
+
+/** Whether the composition respects the %NAV rule, in O(1) */
+template <unsigned K> bool check_compo_cache(const SharpeCache<K> &cache) {
+  // Verify the %NAV of the extreme assets
+  const auto &bounds = cache.bounds;
+  if (bounds.min / cache.start_capital < min_share_percent ||
+      bounds.max / cache.start_capital > max_share_percent) {
+    return false;
+  }
+
+  // TODO: Check stock proportion
+  return true;
+}
+
+/** Sharpe of the composition of the cache */
+template <unsigned K> sharpe_t cache_sharpe(const SharpeCache<K> &cache) {
+  return finmath::sharpe(finmath::PortfolioSums{
+      cache.start_capital, cache.end_capital, cache.variance});
+}
+
 /** Compute the sharpe of the composition and initialize the cache
  * that can after be used in `recompute_sharpe`
  */
-sharpe_t compute_sharpe_init_chache(const TrucsInteressants &trucs,
-                                    const compo_t &compo, SharpeCache &cache);
+template <unsigned K>
+sharpe_t compute_sharpe_init_chache(const finmath::FixedComposition<K> &compo,
+                                    SharpeCache<K> &cache) {
+  const auto &cov_matrix = cache.trucs.cov_matrix;
+  cache.compo = compo;
+  cache.start_capital = compo.start_capital();
+  cache.end_capital = compo.end_capital(cache.trucs.end_values);
+
+  auto assets = compo.assets();
+  auto buy_values = compo.buy_values();
+  auto &cov_w = cache.cov_w_buffers[cache.i_cov_w];
+  cache.variance = 0;
+  for (auto i = 0u; i < K; ++i) {
+    cov_w[i] = 0;
+    for (auto j = 0u; j < K; ++j) {
+      cov_w[i] += cov_matrix(assets[i], assets[j]) * buy_values[j];
+    }
+    cache.variance += buy_values[i] * cov_w[i];
+  }
+  cache.bounds = scan_buy_value_bounds(compo);
+
+  return cache_sharpe(cache);
+}
+
+/** Keep the state of the cache before a change of the asset at `i_compo` */
+template <unsigned K> void save_undo(SharpeCache<K> &cache, unsigned i_compo) {
+  auto &undo = cache.undo;
+  undo.i_compo = i_compo;
+  undo.i_asset = cache.compo.assets()[i_compo];
+  undo.nb_shares = cache.compo.shares()[i_compo];
+  undo.start_capital = cache.start_capital;
+  undo.end_capital = cache.end_capital;
+  undo.variance = cache.variance;
+  undo.i_cov_w = cache.i_cov_w;
+  undo.bounds = cache.bounds;
+}
+
+/** Buffer where a change writes the new `cov * w` */
+template <unsigned K> std::array<double, K> &next_cov_w(SharpeCache<K> &cache) {
+  return cache.cov_w_buffers[1 - cache.i_cov_w];
+}
+
+/** Recompute the sharpe after only one asset shares changed, in O(K).
+ * The change can be undone with `undo_change`.
+ */
+template <unsigned K>
+sharpe_t recompute_sharpe(SharpeCache<K> &cache, unsigned i_compo_changed,
+                          int dshares, bool only_update_cache) {
+  const auto &trucs = cache.trucs;
+  auto &compo = cache.compo;
+  auto i_asset = compo.assets()[i_compo_changed];
+  auto nb_shares = compo.shares()[i_compo_changed];
+  save_undo(cache, i_compo_changed);
+
+  compo.set_shares(i_compo_changed, nb_shares + dshares,
+                   trucs.start_values[i_asset]);
+  auto dw = dshares * trucs.start_values[i_asset];
+
+  // Update start & end capital
+  cache.start_capital += dw;
+  cache.end_capital += dshares * trucs.end_values[i_asset];
+
+  // Rank-1 update of the variance terms
+  const auto &cov_w = cache.cov_w();
+  auto &new_cov_w = next_cov_w(cache);
+  cache.variance += dw * (2 * cov_w[i_compo_changed] +
+                          dw * trucs.cov_matrix(i_asset, i_asset));
+  auto assets = compo.assets();
+  for (auto j = 0u; j < K; ++j) {
+    new_cov_w[j] = cov_w[j] + dw * trucs.cov_matrix(assets[j], i_asset);
+  }
+  cache.i_cov_w = 1 - cache.i_cov_w;
+  update_buy_value_bounds(cache, i_compo_changed);
+
+  if (only_update_cache || !check_compo_cache(cache))
+    return -INFINITY;
+
+  return cache_sharpe(cache);
+}
+
+/** Recompute the sharpe after the asset at `i_compo` is replaced by
+ * `nb_shares` of the asset `i_asset`, which must not be in the composition.
+ * The variance is updated in O(K) with the covariances of the two assets.
+ * The change can be undone with `undo_change`.
+ */
+template <unsigned K>
+sharpe_t swap_asset(SharpeCache<K> &cache, unsigned i_compo,
+                    share_index_t i_asset, nb_shares_t nb_shares,
+                    bool only_update_cache) {
+  const auto &trucs = cache.trucs;
+  const auto &cov_matrix = trucs.cov_matrix;
+  auto &compo = cache.compo;
+  auto assets = compo.assets();
+  auto old_asset = assets[i_compo];
+  auto old_shares = compo.shares()[i_compo];
+  auto old_buy_value = compo.buy_values()[i_compo];
+  auto old_self_cov = cov_matrix(old_asset, old_asset);
+  save_undo(cache, i_compo);
+
+  const auto &cov_w = cache.cov_w();
+  auto &new_cov_w = next_cov_w(cache);
+
+  // Remove the old asset
+  cache.variance -=
+      old_buy_value * (2 * cov_w[i_compo] - old_buy_value * old_self_cov);
+
+  // Add the new one
+  compo.set_asset(i_compo, i_asset, nb_shares, trucs.start_values[i_asset]);
+  auto buy_value = compo.buy_values()[i_compo];
+  auto self_cov = cov_matrix(i_asset, i_asset);
+
+  double cross = 0;
+  for (auto j = 0u; j < K; ++j) {
+    if (j != i_compo) {
+      auto cov = cov_matrix(assets[j], i_asset);
+      cross += cov * compo.buy_values()[j];
+      new_cov_w[j] = cov_w[j] -
+                     old_buy_value * cov_matrix(assets[j], old_asset) +
+                     buy_value * cov;
+    }
+  }
+  new_cov_w[i_compo] = cross + buy_value * self_cov;
+  cache.variance += buy_value * (2 * cross + buy_value * self_cov);
+  cache.i_cov_w = 1 - cache.i_cov_w;
+  update_buy_value_bounds(cache, i_compo);
+
+  cache.start_capital += buy_value - old_buy_value;
+  cache.end_capital += (double)nb_shares * trucs.end_values[i_asset] -
+                       (double)old_shares * trucs.end_values[old_asset];
+
+  if (only_update_cache || !check_compo_cache(cache))
+    return -INFINITY;
+
+  return cache_sharpe(cache);
+}
+
+/** Undo the last change of the cache, exactly and in O(1) */
+template <unsigned K> void undo_change(SharpeCache<K> &cache) {
+  const auto &undo = cache.undo;
+  cache.compo.set_asset(undo.i_compo, undo.i_asset, undo.nb_shares,
+                        cache.trucs.start_values[undo.i_asset]);
+  cache.start_capital = undo.start_capital;
+  cache.end_capital = undo.end_capital;
+  cache.variance = undo.variance;
+  cache.i_cov_w = undo.i_cov_w;
+  cache.bounds = undo.bounds;
+}
+
+/** Composition of the cache before its last change, for the optimizers that
+ * only keep their best composition once they move away from it */
+template <unsigned K>
+finmath::FixedComposition<K> compo_before_change(const SharpeCache<K> &cache) {
+  const auto &undo = cache.undo;
+  auto compo = cache.compo;
+  compo.set_asset(undo.i_compo, undo.i_asset, undo.nb_shares,
+                  cache.trucs.start_values[undo.i_asset]);
+  return compo;
+}
+
+/** Probability of a random move to swap an asset of the composition instead
+ * of changing its shares */
+constexpr auto swap_probability = 0.1;
+
+/** Standard deviation of the change of shares of a random move */
+constexpr auto dshares_deviation = 50.0;
+
+/** `MoveProposal::new_asset` of the moves that change the shares */
+constexpr auto no_swap = std::numeric_limits<share_index_t>::max();
+
+/** Random move of a composition, drawn before knowing its state */
+struct MoveProposal {
+  unsigned i_compo;
+
+  /** Asset to swap the one at `i_compo` for, or `no_swap` */
+  share_index_t new_asset;
+
+  /** Change of the shares, never 0 */
+  int dshares;
+};
+
+/** Random moves drawn by blocks, so that the generator and the distributions
+ * run in a tight loop apart from the sharpe updates */
+struct MoveProposals {
+  static constexpr unsigned block_size = 256;
+
+  Xoshiro256pp gen;
+  std::array<MoveProposal, block_size> block;
+  unsigned next = block_size;
+
+  explicit MoveProposals(std::uint64_t seed) : gen(seed), block() {}
+};
+
+/** Draw a new block of moves for compositions of `portfolio_size` assets
+ * among `nb_assets` */
+void fill_proposals(MoveProposals &proposals, unsigned portfolio_size,
+                    unsigned nb_assets);
+
+/** Extreme buy values of the assets other than the one at `i_compo` */
+template <unsigned K>
+BuyValueBounds other_buy_value_bounds(const SharpeCache<K> &cache,
+                                      unsigned i_compo) {
+  const auto &bounds = cache.bounds;
+  if (i_compo == bounds.i_min || i_compo == bounds.i_max)
+    return scan_buy_value_bounds(cache.compo, i_compo);
+  return bounds;
+}
+
+/** Interval of the changes of shares of the asset at `i_compo` that keep
+ * the composition within the %NAV rule and the available shares. With C the
+ * start capital and b the buy values, a change dw of b_i must keep
+ * `min% * (C + dw) <= b_j + [j == i] * dw <= max% * (C + dw)` for every j,
+ * which gives closed-form bounds from b_i and the extremes of the others.
+ * \return an empty interval (first > second) when there is no feasible
+ * change
+ */
+template <unsigned K>
+std::pair<int, int> feasible_dshares(const SharpeCache<K> &cache,
+                                     unsigned i_compo,
+                                     const BuyValueBounds &others) {
+  const auto &compo = cache.compo;
+  auto i_asset = compo.assets()[i_compo];
+  auto buy_value = compo.buy_values()[i_compo];
+  auto capital = cache.start_capital;
+
+  auto dw_min = std::max((min_share_percent * capital - buy_value) /
+                             (1 - min_share_percent),
+                         others.max / max_share_percent - capital);
+  auto dw_max = std::min((max_share_percent * capital - buy_value) /
+                             (1 - max_share_percent),
+                         others.min / min_share_percent - capital);
+
+  // Bounds of the number of shares, clamped before the conversion
+  int shares = compo.shares()[i_compo];
+  double min_dshares = 1 - shares;
+  double max_dshares = (double)cache.trucs.nb_shares[i_asset] - shares;
+  auto start_value = cache.trucs.start_values[i_asset];
+  return {(int)std::ceil(std::clamp(dw_min / start_value, min_dshares,
+                                    max_dshares + 1)),
+          (int)std::floor(std::clamp(dw_max / start_value, min_dshares - 1,
+                                     max_dshares))};
+}
+
+template <unsigned K>
+std::pair<int, int> feasible_dshares(const SharpeCache<K> &cache,
+                                     unsigned i_compo) {
+  return feasible_dshares(cache, i_compo,
+                          other_buy_value_bounds(cache, i_compo));
+}
+
+/** Change of shares of an asset, with the sharpe it leads to */
+struct SingleMove {
+  int dshares;
+  sharpe_t sharpe;
+};
+
+/** Best change of the shares of an asset in a portfolio of the given sums,
+ * within [min_dx, max_dx] and different from 0. With dw the change of its buy
+ * value, the sharpe is `(a + b * dw) / sqrt(V + 2 * g * dw + s * dw^2)` where
+ * g is the covariance of the asset with the portfolio and s its variance. Its
+ * only stationary point is `dw = (a * g - b * V) / (b * g - a * s)`, so only
+ * the shares around it and the ends of the interval need to be evaluated.
+ * \return the best change, with 0 shares and a -inf sharpe when there is none
+ */
+inline SingleMove best_step(const finmath::PortfolioSums &sums,
+                            double start_value, double end_value, double g,
+                            double s, int min_dx, int max_dx) {
+  auto best = SingleMove{0, -INFINITY};
+  if (min_dx > max_dx)
+    return best;
+
+  // Return of the portfolio, without its division by the capital
+  auto a = sums.end_capital - sums.start_capital;
+  auto b = end_value / start_value - 1;
+
+  auto candidates = std::array<double, 4>{(double)min_dx, (double)max_dx,
+                                          (double)min_dx, (double)max_dx};
+  auto denominator = b * g - a * s;
+  if (denominator != 0) {
+    auto dx = (a * g - b * sums.variance) / denominator / start_value;
+    candidates[2] = std::clamp(std::floor(dx), (double)min_dx, (double)max_dx);
+    candidates[3] = std::clamp(std::ceil(dx), (double)min_dx, (double)max_dx);
+  }
+
+  for (auto candidate : candidates) {
+    auto dx = (int)candidate;
+    if (dx == 0)
+      continue;
+
+    auto dw = dx * start_value;
+    auto sharpe = finmath::sharpe(finmath::PortfolioSums{
+        sums.start_capital + dw, sums.end_capital + dx * end_value,
+        sums.variance + dw * (2 * g + dw * s)});
+    if (sharpe > best.sharpe) {
+      best = SingleMove{dx, sharpe};
+    }
+  }
+  return best;
+}
+
+/** Best change of shares of the asset at `i_compo`, within its feasible
+ * interval, found by `best_step` in O(1).
+ * `others` are the extreme buy values of the other assets.
+ * \return the best move, with 0 shares and the current sharpe when none
+ * improves it
+ */
+template <unsigned K>
+SingleMove best_single_move(const SharpeCache<K> &cache, unsigned i_compo,
+                            const BuyValueBounds &others) {
+  const auto &trucs = cache.trucs;
+  auto current = SingleMove{0, cache_sharpe(cache)};
+  auto [min_dx, max_dx] = feasible_dshares(cache, i_compo, others);
+
+  auto i_asset = cache.compo.assets()[i_compo];
+  auto step = best_step(
+      finmath::PortfolioSums{cache.start_capital, cache.end_capital,
+                             cache.variance},
+      trucs.start_values[i_asset], trucs.end_values[i_asset],
+      cache.cov_w()[i_compo], trucs.cov_matrix(i_asset, i_asset), min_dx,
+      max_dx);
+  return step.sharpe > current.sharpe ? step : current;
+}
+
+/** Score the best move of every asset in one pass, in O(K): since the best
+ * change of shares of an asset is given in closed form, it stands for all
+ * the changes of that asset. The extremes of the other assets come from the
+ * two smallest and the two largest buy values, computed once.
+ */
+template <unsigned K>
+std::array<SingleMove, K> evaluate_single_moves(const SharpeCache<K> &cache) {
+  const auto &bounds = cache.bounds;
+  auto without_min = scan_buy_value_bounds(cache.compo, bounds.i_min);
+  auto without_max = scan_buy_value_bounds(cache.compo, bounds.i_max);
+
+  auto moves = std::array<SingleMove, K>();
+
+  for (auto i = 0u; i < K; ++i) {
+    auto others = bounds;
+    if (i == bounds.i_min && i == bounds.i_max) {
+      others = scan_buy_value_bounds(cache.compo, i);
+    } else if (i == bounds.i_min) {
+      others.min = without_min.min;
+    } else if (i == bounds.i_max) {
+      others.max = without_max.max;
+    }
+    moves[i] = best_single_move(cache, i, others);
+  }
+  return moves;
+}
+
+/** Maximum number of moves of a steepest ascent, far more than it needs to
+ * converge */
+constexpr unsigned max_ascent_moves = 100000;
+
+/** Apply the best single move of all the assets until none improves the
+ * sharpe, or `max_moves` were applied
+ * \return the sharpe of the composition of the cache
+ */
+template <unsigned K>
+sharpe_t steepest_ascent(SharpeCache<K> &cache, unsigned max_moves) {
+  for (auto _i = 0u; _i < max_moves; ++_i) {
+    auto moves = evaluate_single_moves(cache);
 
-/** Recompute the sharpe after only one asset shares changed */
-sharpe_t recompute_sharpe(SharpeCache &cache, unsigned i_compo_changed,
-                          double dshares, bool only_update_cache);
+    auto best = std::max_element(
+        moves.begin(), moves.end(),
+        [](const auto &a, const auto &b) { return a.sharpe < b.sharpe; });
+    if (best->dshares == 0)
+      break;
 
-bool check_compo_cache(const SharpeCache &cache);
+    recompute_sharpe(cache, best - moves.begin(), best->dshares, true);
+  }
+  return cache_sharpe(cache);
+}
 
-/** Try to optimize a composition by changing the number of shares.
+/** Swap the asset at `i_compo` for `new_asset` with the same buy value, as
+ * cheap as changing its shares
+ * \return the new sharpe like `swap_asset`, nothing if `new_asset` is already
+ * in the composition
+ */
+template <unsigned K>
+std::optional<sharpe_t> swap_same_value(SharpeCache<K> &cache, unsigned i_compo,
+                                        share_index_t new_asset) {
+  const auto &trucs = cache.trucs;
+  const auto &compo = cache.compo;
+  auto assets = compo.assets();
+  if (std::find(assets.begin(), assets.end(), new_asset) != assets.end())
+    return std::nullopt;
+
+  auto nb_shares = std::clamp<double>(compo.buy_values()[i_compo] /
+                                          trucs.start_values[new_asset],
+                                      1, trucs.nb_shares[new_asset]);
+  return swap_asset(cache, i_compo, new_asset, nb_shares, false);
+}
+
+/** Apply the next random move to the composition of the cache: change the
+ * shares of an asset, or swap it for another asset with the same buy value.
+ * \return the new sharpe like `recompute_sharpe`, nothing if the move was
+ * not applied
+ */
+template <unsigned K>
+std::optional<sharpe_t> random_move(SharpeCache<K> &cache,
+                                    MoveProposals &proposals) {
+  const auto &trucs = cache.trucs;
+  const auto &compo = cache.compo;
+  if (proposals.next == MoveProposals::block_size) {
+    fill_proposals(proposals, K, trucs.start_values.size());
+  }
+  const auto &move = proposals.block[proposals.next++];
+  auto i = move.i_compo;
+
+  if (move.new_asset != no_swap)
+    return swap_same_value(cache, i, move.new_asset);
+
+  int shares = compo.shares()[i];
+  if (!check_compo_cache(cache)) {
+    // Only clamp the share modifier to be in bound, until the composition
+    // becomes feasible
+    auto dx = std::max<int>(-shares + 1, move.dshares);
+    dx = std::min<int>(dx, trucs.nb_shares[compo.assets()[i]] - shares);
+    return recompute_sharpe(cache, i, dx, false);
+  }
+
+  // Clamp the share modifier to the feasible changes, in the other direction
+  // when there is none in the drawn one
+  auto [min_dx, max_dx] = feasible_dshares(cache, i);
+  auto dx = move.dshares;
+  if (dx > 0 && max_dx < 1) {
+    dx = -dx;
+  } else if (dx < 0 && min_dx > -1) {
+    dx = -dx;
+  }
+  dx = dx > 0 ? std::min(dx, max_dx) : std::max(dx, min_dx);
+  if (dx == 0 || dx < min_dx || dx > max_dx)
+    return std::nullopt;
+
+  return recompute_sharpe(cache, i, dx, false);
+}
+
+/** Try to optimize a composition by changing the number of shares, with a
+ * `steepest_ascent`, and its assets, with the best swaps of `best_swaps`
+ * scored on the workers of `pool`.
  * If the given composition respects the %NAV rule, the resulting
  * composition will also respect it.
  */
 std::tuple<compo_t, sharpe_t>
-optimize_compo_stochastic(const TrucsInteressants &trucs, compo_t compo);
+optimize_compo_stochastic(const TrucsInteressants &trucs,
+                          const compo_t &start_compo,
+                          WorkStealingPool<unsigned> &pool);
 
+/** Steepest ascent of the shares, with the sharpe given by `get_sharpe`.
+ * The moves are scored by `evaluate_single_moves` on the local model, and
+ * `get_sharpe` is only called to confirm the best one: a rejected asset is
+ * skipped until another move is confirmed. `quick` stops after K calls.
+ */
 std::tuple<compo_t, sharpe_t>
 optimize_compo_2(const TrucsInteressants &trucs, compo_t compo, sharpe_t sharpe,
                  std::function<double(const compo_t &)> get_sharpe,
                  bool quick = false);
 
-/** Try to find the best composition by using the stochastic optimizer */
-compo_t
+/** Try to find the `nb_results` best compositions of `portfolio_size` assets
+ * by using the stochastic optimizer, until the process is interrupted.
+ * `nb_chains` chains run on their own thread, 0 for one per hardware thread.
+ * `get_sharpe` is only called from the calling thread.
+ * \throw std::out_of_range if `portfolio_size` is not a supported size
+ * \throw std::invalid_argument if there are not more assets than
+ * `portfolio_size`
+ */
+TopCompos
 find_best_compo_stochastic(const TrucsInteressants &trucs, compo_t compo,
-                           std::function<double(const compo_t &)> get_sharpe);
+                           std::function<double(const compo_t &)> get_sharpe,
+                           unsigned portfolio_size, unsigned nb_results,
+                           unsigned nb_chains = 0);
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "stochastic.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <span>
+#include <vector>
+
+/** Swap of an asset of a composition for an asset out of it */
+struct SwapMove {
+  unsigned i_compo;
+  share_index_t i_asset;
+  nb_shares_t nb_shares;
+  sharpe_t sharpe;
+};
+
+/** Number of candidate assets scored by a task */
+constexpr unsigned swap_block_size = 64;
+
+/** Sums of a composition without one of its assets */
+struct RemovedAsset {
+  finmath::PortfolioSums sums;
+
+  /** Extreme buy values of the remaining assets */
+  double min_buy_value;
+  double max_buy_value;
+};
+
+/** Sums of the composition of the cache without each of its assets, in O(K)
+ * with `cov_w` */
+template <unsigned K>
+std::array<RemovedAsset, K> removed_assets(const SharpeCache<K> &cache) {
+  const auto &trucs = cache.trucs;
+  const auto &compo = cache.compo;
+  const auto &bounds = cache.bounds;
+  auto without_min = scan_buy_value_bounds(compo, bounds.i_min);
+  auto without_max = scan_buy_value_bounds(compo, bounds.i_max);
+
+  auto removed = std::array<RemovedAsset, K>();
+  for (auto i = 0u; i < K; ++i) {
+    auto i_asset = compo.assets()[i];
+    auto buy_value = compo.buy_values()[i];
+    removed[i].sums = finmath::PortfolioSums{
+        cache.start_capital - buy_value,
+        cache.end_capital - compo.shares()[i] * trucs.end_values[i_asset],
+        cache.variance -
+            buy_value * (2 * cache.cov_w()[i] -
+                         buy_value * trucs.cov_matrix(i_asset, i_asset))};
+    removed[i].min_buy_value =
+        i == bounds.i_min ? without_min.min : bounds.min;
+    removed[i].max_buy_value =
+        i == bounds.i_max ? without_max.max : bounds.max;
+  }
+  return removed;
+}
+
+/** Keep the `nb_swaps` best swaps in the min-heap `best` */
+inline void keep_best_swap(std::vector<SwapMove> &best, unsigned nb_swaps,
+                           const SwapMove &swap) {
+  auto worse = [](const SwapMove &a, const SwapMove &b) {
+    return a.sharpe > b.sharpe;
+  };
+  if (best.size() < nb_swaps) {
+    best.push_back(swap);
+    std::push_heap(best.begin(), best.end(), worse);
+  } else if (swap.sharpe > best.front().sharpe) {
+    std::pop_heap(best.begin(), best.end(), worse);
+    best.back() = swap;
+    std::push_heap(best.begin(), best.end(), worse);
+  }
+}
+
+/** Score the swaps of every asset of the composition for the candidates in
+ * [first, last), and keep the `nb_swaps` best ones in `best`.
+ * The covariances of a candidate with the composition are gathered once from
+ * its row and reused by the K swaps. Removing an asset i of buy value b_i
+ * leaves the covariance `cov_w[j] - cov(j, i) * b_i` between the candidate j
+ * and the rest, then the candidate is sized by `best_step` within the %NAV
+ * rule of the new composition.
+ */
+template <unsigned K>
+void score_swaps(const SharpeCache<K> &cache,
+                 std::span<const RemovedAsset> removed,
+                 const std::vector<char> &in_compo, share_index_t first,
+                 share_index_t last, unsigned nb_swaps,
+                 std::vector<SwapMove> &best) {
+  const auto &trucs = cache.trucs;
+  auto assets = cache.compo.assets();
+  auto buy_values = cache.compo.buy_values();
+
+  auto cov = std::array<double, K>();
+  for (auto candidate = first; candidate < last; ++candidate) {
+    if (in_compo[candidate])
+      continue;
+
+    // Covariance of the candidate with every asset and with the portfolio
+    double cov_portfolio = 0;
+    for (auto j = 0u; j < K; ++j) {
+      cov[j] = trucs.cov_matrix(candidate, assets[j]);
+      cov_portfolio += cov[j] * buy_values[j];
+    }
+
+    auto start_value = trucs.start_values[candidate];
+    auto end_value = trucs.end_values[candidate];
+    auto self_cov = trucs.cov_matrix(candidate, candidate);
+    for (auto i = 0u; i < K; ++i) {
+      const auto &rest = removed[i];
+      auto capital = rest.sums.start_capital;
+
+      // Buy values keeping the candidate and the rest within the %NAV rule
+      auto min_buy_value =
+          std::max(rest.max_buy_value / max_share_percent - capital,
+                   min_share_percent * capital / (1 - min_share_percent));
+      auto max_buy_value =
+          std::min(rest.min_buy_value / min_share_percent - capital,
+                   max_share_percent * capital / (1 - max_share_percent));
+      auto min_shares =
+          std::max(1.0, std::ceil(min_buy_value / start_value));
+      auto max_shares = std::min((double)trucs.nb_shares[candidate],
+                                 std::floor(max_buy_value / start_value));
+      if (min_shares > max_shares)
+        continue;
+
+      auto step = best_step(rest.sums, start_value, end_value,
+                            cov_portfolio - cov[i] * buy_values[i], self_cov,
+                            (int)min_shares, (int)max_shares);
+      keep_best_swap(best, nb_swaps,
+                     SwapMove{i, candidate, (nb_shares_t)step.dshares,
+                              step.sharpe});
+    }
+  }
+}
+
+/** Score every swap of an asset of the composition for an asset out of it,
+ * with the new asset sized at its best within the %NAV rule, in O(N * K).
+ * The candidates are scored by blocks on the workers of `pool`, which is
+ * reused by the successive calls of a local search.
+ * \return the `nb_swaps` best swaps, from the best one
+ */
+template <unsigned K>
+std::vector<SwapMove> best_swaps(const SharpeCache<K> &cache,
+                                 unsigned nb_swaps,
+                                 WorkStealingPool<unsigned> &pool) {
+  auto nb_assets = (share_index_t)cache.trucs.start_values.size();
+  auto removed = removed_assets(cache);
+  auto in_compo = std::vector<char>(nb_assets, false);
+  for (auto i_asset : cache.compo.assets()) {
+    in_compo[i_asset] = true;
+  }
+
+  auto nb_blocks = (nb_assets + swap_block_size - 1) / swap_block_size;
+  auto block_best = std::vector<std::vector<SwapMove>>(nb_blocks);
+  auto score_block = [&](unsigned i_block) {
+    auto first = i_block * swap_block_size;
+    auto last = std::min(nb_assets, first + swap_block_size);
+    score_swaps(cache, removed, in_compo, first, last, nb_swaps,
+                block_best[i_block]);
+  };
+
+  if (pool.nb_workers() == 1) {
+    for (auto i_block = 0u; i_block < nb_blocks; ++i_block) {
+      score_block(i_block);
+    }
+  } else {
+    auto blocks = std::vector<unsigned>(nb_blocks);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    pool.run(std::move(blocks),
+             [&](unsigned &&i_block, unsigned) { score_block(i_block); });
+  }
+
+  auto best = std::vector<SwapMove>();
+  for (const auto &block : block_best) {
+    for (const auto &swap : block) {
+      keep_best_swap(best, nb_swaps, swap);
+    }
+  }
+  std::sort(best.begin(), best.end(), [](const auto &a, const auto &b) {
+    return a.sharpe > b.sharpe;
+  });
+  return best;
+}
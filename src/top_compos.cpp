@@ -0,0 +1,70 @@
+#include "top_compos.hpp"
+
+#include <algorithm>
+
+namespace {
+/** Order of the heap: the worst composition is at its front */
+bool better_sharpe(const ScoredCompo &a, const ScoredCompo &b) {
+  return a.sharpe > b.sharpe;
+}
+
+/** Spread the bits of an asset index (splitmix64 finalizer) */
+std::uint64_t mix(std::uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+} // namespace
+
+std::uint64_t assets_hash(const finmath::investments_t &compo) {
+  // A sum does not depend on the order of the assets
+  std::uint64_t hash = 0;
+  for (const auto &[_nb_shares, i_asset] : compo) {
+    hash += mix(i_asset + 1);
+  }
+  return hash;
+}
+
+bool TopCompos::push(double sharpe, const finmath::investments_t &compo) {
+  if (sharpe <= threshold())
+    return false;
+  return push(ScoredCompo{sharpe, compo, assets_hash(compo)});
+}
+
+bool TopCompos::push(ScoredCompo &&scored) {
+  if (capacity_ == 0 || scored.sharpe <= threshold())
+    return false;
+
+  auto duplicate =
+      std::find_if(heap_.begin(), heap_.end(), [&scored](const auto &other) {
+        return other.assets_hash == scored.assets_hash;
+      });
+  if (duplicate != heap_.end()) {
+    if (duplicate->sharpe >= scored.sharpe)
+      return false;
+
+    *duplicate = std::move(scored);
+    std::make_heap(heap_.begin(), heap_.end(), better_sharpe);
+    return true;
+  }
+
+  if (heap_.size() == capacity_) {
+    std::pop_heap(heap_.begin(), heap_.end(), better_sharpe);
+    heap_.pop_back();
+  }
+  heap_.push_back(std::move(scored));
+  std::push_heap(heap_.begin(), heap_.end(), better_sharpe);
+  return true;
+}
+
+void TopCompos::merge(const TopCompos &other) {
+  for (auto scored : other.heap_) {
+    push(std::move(scored));
+  }
+}
+
+std::vector<ScoredCompo> TopCompos::ranked() const {
+  auto ranked = heap_;
+  std::sort(ranked.begin(), ranked.end(), better_sharpe);
+  return ranked;
+}
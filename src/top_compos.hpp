@@ -0,0 +1,55 @@
+#pragma once
+
+#include "finmath.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/** A composition found by a solver and its sharpe */
+struct ScoredCompo {
+  double sharpe;
+  finmath::investments_t compo;
+
+  /** Hash of the set of assets of the composition */
+  std::uint64_t assets_hash;
+};
+
+/** Hash of the set of assets of a composition, independent of their order */
+std::uint64_t assets_hash(const finmath::investments_t &compo);
+
+/** The best compositions found by a solver, with distinct sets of assets.
+ * Kept in a min-heap bounded to `capacity` compositions, so that the worst
+ * one is the next to be replaced.
+ */
+class TopCompos {
+public:
+  explicit TopCompos(unsigned capacity) : capacity_(capacity) {}
+
+  std::size_t size() const { return heap_.size(); }
+  bool empty() const { return heap_.empty(); }
+
+  /** Sharpe a composition must beat to enter the results, -inf while they
+   * are not full */
+  double threshold() const {
+    return heap_.size() < capacity_ ? -INFINITY : heap_.front().sharpe;
+  }
+
+  /** Add the composition if it beats the threshold. If a composition with
+   * the same assets is already kept, only the best of the two is kept.
+   * \return true if the composition has been added
+   */
+  bool push(double sharpe, const finmath::investments_t &compo);
+
+  /** Add the compositions of other results */
+  void merge(const TopCompos &other);
+
+  /** The compositions, from the best one to the worst one */
+  std::vector<ScoredCompo> ranked() const;
+
+private:
+  bool push(ScoredCompo &&scored);
+
+  unsigned capacity_;
+  std::vector<ScoredCompo> heap_;
+};
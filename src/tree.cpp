@@ -1,7 +1,21 @@
 #include "tree.hpp"
+#include "work_pool.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+namespace {
+volatile std::sig_atomic_t interrupted = false;
+}
+
+static void interrupt_handler(int) { interrupted = true; }
 
 double portolio_capital(const TrucsInteressants &trucs, const compo_t &compo) {
   double r = 0;
@@ -11,123 +25,579 @@ double portolio_capital(const TrucsInteressants &trucs, const compo_t &compo) {
   return r;
 }
 
-sharpe_t compute_sharpe(const TrucsInteressants &trucs, const compo_t &compo,
-                        finmath::asset_period_values_t &shares_capital) {
-  shares_capital.resize(0);
-  auto compo_cap = portolio_capital(trucs, compo);
-  for (const auto &[nb_shares, i_asset] : compo) {
-    auto share_capital = nb_shares * trucs.start_values[i_asset];
-    shares_capital.push_back(share_capital);
+sharpe_t compute_sharpe(const TrucsInteressants &trucs, const compo_t &compo) {
+  return finmath::sharpe(finmath::portfolio_sums(
+      trucs.cov_matrix, trucs.start_values, trucs.end_values, compo));
+}
+
+std::vector<share_index_t> assets_by_capital(const TrucsInteressants &trucs) {
+  auto order = std::vector<share_index_t>(trucs.assets_capital.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&trucs](auto a, auto b) {
+    return trucs.assets_capital[a] < trucs.assets_capital[b];
+  });
+  return order;
+}
+
+void BestSharpeRecord::update(sharpe_t sharpe, unsigned slot) {
+  // Flip the float bits so that the keys are ordered like the sharpes
+  auto value = float(sharpe);
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  bits = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+  auto packed = (std::uint64_t(bits) << 32) | slot;
+
+  auto current = packed_.load(std::memory_order_relaxed);
+  while ((current >> 32) < bits &&
+         !packed_.compare_exchange_weak(current, packed,
+                                        std::memory_order_relaxed)) {
   }
+}
 
-  double sell_value = 0;
-  { // Compute sell value
-    for (const auto &[nb_shares, i_asset] : compo) {
-      sell_value += nb_shares * trucs.end_values[i_asset];
-    }
+std::optional<std::tuple<float, unsigned>> BestSharpeRecord::load() const {
+  auto packed = packed_.load(std::memory_order_relaxed);
+  if (packed == 0)
+    return std::nullopt;
+
+  auto bits = std::uint32_t(packed >> 32);
+  bits = (bits & 0x80000000u) ? bits & ~0x80000000u : ~bits;
+  float sharpe;
+  std::memcpy(&sharpe, &bits, sizeof(sharpe));
+  return std::tuple(sharpe, unsigned(packed));
+}
+
+/** Publish a new results threshold to the other threads */
+static void publish_sharpe(TreeSearchShared &shared, sharpe_t sharpe) {
+  auto current = shared.min_sharpe.load(std::memory_order_relaxed);
+  while (current < sharpe && !shared.min_sharpe.compare_exchange_weak(
+                                 current, sharpe, std::memory_order_relaxed)) {
+  }
+}
+
+/** Compute the partial sums after adding the asset at `pos` to the partial
+ * composition of `from`. The cross terms are only updated for the positions
+ * after `pos`, the only ones that can still be added.
+ */
+template <unsigned K>
+static void push_depth(const TreeSearch<K> &search, const TreeDepth &from,
+                       TreeDepth &to, unsigned pos) {
+  auto asset = search.order[pos];
+  auto cov_vec = search.trucs.cov_matrix.row(asset);
+  auto buy_value = search.buy_values[pos];
+
+  to.sums.start_capital = from.sums.start_capital + buy_value;
+  to.sums.end_capital = from.sums.end_capital + search.sell_values[pos];
+  to.sums.variance =
+      from.sums.variance +
+      buy_value * (buy_value * cov_vec[asset] + 2 * from.cross[pos]);
+
+  to.cross.resize(search.order.size());
+  for (auto pos2 = pos + 1; pos2 < search.order.size(); ++pos2) {
+    to.cross[pos2] = from.cross[pos2] + buy_value * cov_vec[search.order[pos2]];
   }
+}
 
-  double vol = 0;
-  { // Compute volatility
-    for (auto i = 0u; i < compo.size(); ++i) {
-      const auto &asset1 = std::get<1>(compo[i]);
+/** Compute an upper bound of the sharpe of every composition that starts
+ * with the partial composition of `depth` and whose other assets are taken
+ * from the positions starting at `next_pos`.
+ *
+ * When positive, the sharpe is lower than `sum(gains) / sqrt(variance)`.
+ * The gains are bounded by the best gains of the candidates and the variance
+ * by the smallest contributions of the candidates to the variance.
+ */
+template <unsigned K>
+static sharpe_t sharpe_upper_bound(TreeSearch<K> &search,
+                                   const TreeDepth &depth, unsigned next_pos) {
+  const auto &cov_matrix = search.trucs.cov_matrix;
+  auto nb_missing = K - search.nb_positions;
+  auto nb_candidates = search.order.size() - next_pos;
 
-      auto tmp = 0;
-      for (auto j = 0u; j < compo.size(); ++j) {
-        const auto &asset2 = std::get<1>(compo[j]);
+  auto &scratch = search.scratch;
+  scratch.resize(nb_candidates);
 
-        tmp += shares_capital[j] * trucs.cov_matrix[asset1][asset2];
-      }
+  // Sum of the best candidate gains
+  for (auto i = 0u; i < nb_candidates; ++i) {
+    scratch[i] = search.gains[next_pos + i];
+  }
+  std::nth_element(scratch.begin(), scratch.begin() + nb_missing - 1,
+                   scratch.end(), std::greater<>());
+  auto gain = std::accumulate(scratch.begin(), scratch.begin() + nb_missing,
+                              depth.sums.end_capital -
+                                  depth.sums.start_capital);
+
+  // The portfolio sharpe is negative
+  if (gain <= 0)
+    return 0;
 
-      vol += shares_capital[i] * tmp;
+  // Sum of the smallest candidate contributions to the variance
+  for (auto i = 0u; i < nb_candidates; ++i) {
+    auto pos = next_pos + i;
+    auto asset = search.order[pos];
+    auto buy_value = search.buy_values[pos];
+
+    scratch[i] = buy_value * (buy_value * cov_matrix(asset, asset) +
+                              2 * depth.cross[pos]);
+    if (nb_missing > 1) {
+      scratch[i] += (nb_missing - 1) * search.min_cross[pos];
     }
-    vol = std::sqrt(vol) / compo_cap;
   }
+  std::nth_element(scratch.begin(), scratch.begin() + nb_missing - 1,
+                   scratch.end());
+  auto var = std::accumulate(scratch.begin(), scratch.begin() + nb_missing,
+                             depth.sums.variance);
 
-  // Portfolio is valid, compute sharpe
-  return (sell_value / compo_cap - 1) / (vol + 1e-8);
+  if (var <= 0)
+    return INFINITY;
+  return gain / std::sqrt(var);
 }
 
-/** Try to create the best portfolio from a combination of assets */
-static sharpe_t fill_compo(const TrucsInteressants &trucs, compo_t &compo,
-                           finmath::asset_period_values_t &shares_capital) {
-  // Find the asset with the min capital
-  double min_cap = INFINITY;
-  for (const auto &[_nb_shares, i_asset] : compo) {
-    // std::cerr << trucs.assets_capital[i_asset] << '\n';
-    min_cap = std::min(min_cap, trucs.assets_capital[i_asset]);
+/** Compute the sums of the complete composition made of the partial
+ * composition of `depth` and the asset at `pos`, in O(1) from the partial
+ * sums */
+template <unsigned K>
+static finmath::PortfolioSums leaf_sums(const TreeSearch<K> &search,
+                                        const TreeDepth &depth, unsigned pos) {
+  auto asset = search.order[pos];
+  auto buy_value = search.buy_values[pos];
+
+  auto sums = depth.sums;
+  sums.start_capital += buy_value;
+  sums.end_capital += search.sell_values[pos];
+  sums.variance +=
+      buy_value * (buy_value * search.trucs.cov_matrix(asset, asset) +
+                   2 * depth.cross[pos]);
+  return sums;
+}
+
+/** Evaluate the complete composition made of the partial composition of
+ * `depth` and the asset at `pos` */
+template <unsigned K>
+static void evaluate_leaf(TreeSearch<K> &search, const TreeDepth &depth,
+                          unsigned pos) {
+  auto asset = search.order[pos];
+  auto compo_sharpe = finmath::sharpe(leaf_sums(search, depth, pos));
+  ++search.nb_evaluated;
+
+  if (compo_sharpe > search.results.threshold()) {
+    // Only build the composition when it is among the best ones
+    for (auto i = 0u; i < K - 1; ++i) {
+      search.compo.set_asset(i, search.order[search.positions[i]], 0, 0);
+    }
+    search.compo.set_asset(K - 1, asset, 0, 0);
+
+    auto sharpe = fill_compo(search.trucs, search.compo);
+    search.results.push(sharpe, search.compo.investments());
+    publish_sharpe(search.shared, search.results.threshold());
+    search.shared.best.update(sharpe, search.slot);
   }
+}
+
+/** Compute the values of every position for the compositions whose first
+ * asset is at `first_pos` */
+template <unsigned K>
+static void set_first_position(TreeSearch<K> &search, unsigned first_pos) {
+  if (search.first_pos == first_pos)
+    return;
+  search.first_pos = first_pos;
 
-  // Fill the portfolio
+  const auto &trucs = search.trucs;
+  const auto &order = search.order;
+  auto nb_assets = order.size();
+
+  // The first asset has the min capital, fill the portfolio like `fill_compo`
+  auto min_cap = trucs.assets_capital[order[first_pos]];
   auto max_cap = (max_share_percent / min_share_percent) * min_cap;
-  for (auto &[nb_shares, i_asset] : compo) {
-    nb_shares = max_cap / trucs.start_values[i_asset];
+
+  search.buy_values.resize(nb_assets);
+  search.sell_values.resize(nb_assets);
+  search.gains.resize(nb_assets);
+  for (auto pos = first_pos; pos < nb_assets; ++pos) {
+    auto asset = order[pos];
+    nb_shares_t nb_shares = max_cap / trucs.start_values[asset];
+    search.buy_values[pos] = nb_shares * trucs.start_values[asset];
+    search.sell_values[pos] = nb_shares * trucs.end_values[asset];
+    search.gains[pos] = search.sell_values[pos] - search.buy_values[pos];
   }
 
-  return compute_sharpe(trucs, compo, shares_capital);
-}
+  search.min_cross.resize(nb_assets);
+  for (auto pos1 = first_pos + 1; pos1 < nb_assets; ++pos1) {
+    auto cov_vec = trucs.cov_matrix.row(order[pos1]);
 
-/** Permute the composition
- * \return true if the composition have been permuted,
- * or false if the composition was already the last one
- */
-static bool permute_compo(compo_t &compo, unsigned nb_assets,
-                          unsigned nb_assets_perm) {
-  auto i = 0u;
-  for (; i < nb_assets_perm; ++i) {
-    // Permute this index
-    auto &c = std::get<1>(compo[compo.size() - i - 1]);
-    ++c;
-
-    // If this index has not reach the end, we can stop here
-    // Else we need to permute the previous compo index
-    if (c + i < nb_assets)
-      break;
+    double min_cross = INFINITY;
+    for (auto pos2 = first_pos + 1; pos2 < nb_assets; ++pos2) {
+      if (pos1 != pos2) {
+        min_cross = std::min(min_cross, search.buy_values[pos2] *
+                                            cov_vec[order[pos2]]);
+      }
+    }
+    search.min_cross[pos1] =
+        min_cross == INFINITY ? 0 : search.buy_values[pos1] * min_cross;
   }
+}
 
-  // If all index have been permuted and overset (==nb_assets)
-  // The compo was the last permutation
-  if (i == nb_assets_perm)
+template <unsigned K>
+static void search_range(TreeSearch<K> &search, unsigned first, unsigned last);
+
+/** Min number of compositions in a task given to another worker */
+constexpr double min_split_compositions = 1e4;
+
+/** Whether the compositions of the positions in [first, last) are worth
+ * being split in two tasks */
+template <unsigned K>
+static bool worth_splitting(const TreeSearch<K> &search, unsigned first,
+                            unsigned last) {
+  auto nb_missing = K - search.nb_positions;
+  if (nb_missing < 2 || last - first < 2)
     return false;
 
-  // Set the following index (that are currently == nb_assets)
-  for (; i > 0; --i) {
-    // Set the next index to the current + 1
-    auto &c = std::get<1>(compo[compo.size() - i]);
-    c = std::get<1>(compo[compo.size() - i - 1]) + 1;
+  // Number of compositions of the last half of the range, lower than the
+  // number of compositions starting at its first position
+  auto middle = first + (last - first + 1) / 2;
+  auto nb_candidates = search.order.size() - middle - 1;
+  const auto &log_fact = search.log_factorials;
+  auto log_nb_compos = log_fact[nb_candidates] - log_fact[nb_missing - 1] -
+                       log_fact[nb_candidates - (nb_missing - 1)];
+  return log_nb_compos >= std::log(min_split_compositions);
+}
+
+/** Where the compositions of a subtree are relative to the explored ranks */
+enum class RankLocation { before, inside, after };
+
+/** Locate the subtree of the current partial composition followed by the
+ * asset at `pos`, and keep the rank of its first composition */
+template <unsigned K>
+static RankLocation locate_subtree(TreeSearch<K> &search, unsigned pos) {
+  const auto &shared = search.shared;
+  if (!shared.rank_range)
+    return RankLocation::inside;
+
+  const auto &binomials = *shared.binomials;
+  auto nb_assets = (unsigned)search.order.size();
+  auto depth = search.nb_positions;
+  auto next = depth == 0 ? 0 : search.positions[depth - 1] + 1;
+
+  auto first = extend_rank(search.ranks[depth], next, pos, nb_assets,
+                           K - depth, binomials);
+  auto size = binomials(nb_assets - 1 - pos, K - 1 - depth);
+  search.ranks[depth + 1] = first;
+
+  if (first + size <= shared.rank_range->first)
+    return RankLocation::before;
+  if (first >= shared.rank_range->last)
+    return RankLocation::after;
+  return RankLocation::inside;
+}
+
+/** Add the asset at `pos` to the current partial composition, and either
+ * evaluate the composition, prune its subtree or explore it */
+template <unsigned K>
+static void visit_position(TreeSearch<K> &search, unsigned pos) {
+  auto nb_missing = K - search.nb_positions;
+  const auto &depth = search.depths[search.nb_positions];
+  auto &next_depth = search.depths[search.nb_positions + 1];
+
+  if (search.nb_positions == 0) {
+    set_first_position(search, pos);
+  }
+
+  if (nb_missing == 1) {
+    evaluate_leaf(search, depth, pos);
+    return;
   }
 
-  return true;
+  search.positions[search.nb_positions++] = pos;
+  push_depth(search, depth, next_depth, pos);
+
+  if (sharpe_upper_bound(search, next_depth, pos + 1) <= search.incumbent()) {
+    // Count the compositions of the subtree to estimate the progress
+    const auto &log_fact = search.log_factorials;
+    auto nb_candidates = search.order.size() - pos - 1;
+    ++search.nb_pruned;
+    search.nb_pruned_compos +=
+        std::exp(log_fact[nb_candidates] - log_fact[nb_missing - 1] -
+                 log_fact[nb_candidates - (nb_missing - 1)]);
+  } else {
+    search_range(search, pos + 1,
+                 search.order.size() - (nb_missing - 1) + 1);
+  }
+
+  --search.nb_positions;
 }
 
-std::tuple<compo_t, sharpe_t>
-max_compo_tree2(const TrucsInteressants &trucs,
-                finmath::asset_period_values_t &shares_capital, compo_t &compo,
-                share_index_t start_asset) {
-  auto best_compo = compo_t();
-  auto best_sharpe = -INFINITY;
+/** Number of evaluated compositions and pruned subtrees after which a worker
+ * publishes its counters */
+constexpr unsigned long long counters_publish_period = 1 << 16;
+
+/** Add the counters of the worker to the shared ones */
+template <unsigned K> static void publish_counters(TreeSearch<K> &search) {
+  auto &shared = search.shared;
+  shared.nb_evaluated += search.nb_evaluated;
+  shared.nb_pruned += search.nb_pruned;
 
-  // Create initial composition
-  auto nb_assets_perm = max_portfolio_size - compo.size();
-  for (auto i = start_asset; compo.size() < max_portfolio_size; ++i) {
-    compo.emplace_back(-1, i);
+  auto current = shared.nb_pruned_compos.load(std::memory_order_relaxed);
+  while (!shared.nb_pruned_compos.compare_exchange_weak(
+      current, current + search.nb_pruned_compos, std::memory_order_relaxed)) {
   }
 
-  // Not enough assets => return none found
-  if (std::get<1>(compo.back()) >= trucs.assets_capital.size())
-    return std::make_tuple(best_compo, best_sharpe);
+  search.nb_evaluated = 0;
+  search.nb_pruned = 0;
+  search.nb_pruned_compos = 0;
+}
+
+/** Explore every composition that starts with the current positions and whose
+ * next asset is at a position in [first, last) */
+template <unsigned K>
+static void search_range(TreeSearch<K> &search, unsigned first, unsigned last) {
+  for (auto pos = first; pos < last; ++pos) {
+    if (search.shared.stop.load(std::memory_order_relaxed))
+      return;
+    if (search.nb_evaluated + search.nb_pruned >= counters_publish_period) {
+      publish_counters(search);
+    }
+
+    // Skip the subtrees outside of the explored ranks
+    auto location = locate_subtree(search, pos);
+    if (location == RankLocation::after)
+      break;
+    if (location == RankLocation::before)
+      continue;
+
+    // Give the second half of the remaining positions to an idle worker
+    if (search.splitter->should_split() &&
+        worth_splitting(search, pos, last)) {
+      auto middle = pos + (last - pos + 1) / 2;
+      auto prefix = std::vector<unsigned>(
+          search.positions.begin(),
+          search.positions.begin() + search.nb_positions);
+      search.splitter->give(TreeTask{std::move(prefix), middle, last});
+      last = middle;
+    }
+
+    visit_position(search, pos);
+  }
+}
+
+/** Get the task containing every composition of K assets of `order` */
+template <unsigned K>
+static TreeTask tree_root_task(const std::vector<share_index_t> &order) {
+  // Not enough assets => empty task
+  if (order.size() < K)
+    return TreeTask{{}, 0, 0};
+
+  return TreeTask{{}, 0, unsigned(order.size() - K + 1)};
+}
+
+/** Find the best composition of the task, and keep it in the search if it is
+ * better than its current best one.
+ * When the splitter asks for it, the remaining positions of the current loop
+ * are split in two and the second half is given away.
+ */
+template <unsigned K>
+static void max_compo_tree2(TreeSearch<K> &search, const TreeTask &task,
+                            const TreeSplitter &splitter) {
+  auto nb_assets = search.order.size();
+  search.splitter = &splitter;
+
+  if (search.log_factorials.empty()) {
+    // The empty composition has no cross terms
+    search.depths[0].cross.assign(nb_assets, 0);
+
+    search.log_factorials.resize(nb_assets + 1);
+    search.log_factorials[0] = 0;
+    for (auto n = 1u; n <= nb_assets; ++n) {
+      search.log_factorials[n] = search.log_factorials[n - 1] + std::log(n);
+    }
+  }
+
+  // Rebuild the partial sums of the task prefix
+  search.nb_positions = 0;
+  for (auto pos : task.prefix) {
+    if (search.nb_positions == 0) {
+      set_first_position(search, pos);
+    }
+
+    auto size = search.nb_positions;
+    locate_subtree(search, pos);
+    push_depth(search, search.depths[size], search.depths[size + 1], pos);
+    search.positions[search.nb_positions++] = pos;
+  }
+
+  search_range(search, task.first, task.last);
+  publish_counters(search);
+}
+
+/** Set the ranks explored by the search from the slice */
+template <unsigned K>
+static void set_rank_range(TreeSearchShared &shared, unsigned nb_assets,
+                           const TreeSlice &slice) {
+  if (!slice.rank_range && slice.nb_shards <= 1)
+    return;
+
+  shared.binomials.emplace(nb_assets, K);
+  if (shared.binomials->overflows(nb_assets, K))
+    throw std::overflow_error("Too many compositions to rank them");
+
+  auto nb_compos = (*shared.binomials)(nb_assets, K);
+  shared.rank_range =
+      slice.rank_range
+          ? *slice.rank_range
+          : rank_slice(nb_compos, slice.shard_index, slice.nb_shards);
+
+  std::clog << "Exploring the ranks [" << to_string(shared.rank_range->first)
+            << ", " << to_string(shared.rank_range->last) << ") of "
+            << to_string(nb_compos) << " compositions\n";
+}
+
+/** Period of the progress reports */
+constexpr auto progress_period = std::chrono::seconds(10);
+
+/** Report the progress of the search of `nb_compos` compositions */
+static void report_progress(const TreeSearchShared &shared, double nb_compos,
+                            std::chrono::duration<double> elapsed) {
+  auto nb_evaluated = shared.nb_evaluated.load();
+  auto nb_covered = nb_evaluated + shared.nb_pruned_compos.load();
+
+  // The pruned subtrees can overlap the bounds of a rank range
+  std::clog << "[" << (unsigned long long)elapsed.count() << "s] "
+            << nb_evaluated / elapsed.count() << " compositions/s | "
+            << 100 * std::min(1.0, nb_covered / nb_compos) << "% of "
+            << nb_compos << " covered | Best sharpe: ";
+  if (auto best = shared.best.load()) {
+    auto [sharpe, slot] = *best;
+    std::clog << sharpe << " (thread " << slot << ")\n";
+  } else {
+    std::clog << "none\n";
+  }
+}
 
-  do {
-    // auto t1 = std::chrono::system_clock::now();
-    auto compo_sharpe = fill_compo(trucs, compo, shares_capital);
+/** Report the progress of the search until `done`, and stop it after the
+ * time budget or on SIGINT */
+static void monitor_search(TreeSearchShared &shared, double nb_compos,
+                           std::optional<std::chrono::seconds> time_budget,
+                           std::mutex &mutex, std::condition_variable &cv,
+                           const bool &done) {
+  using clock = std::chrono::steady_clock;
+  auto start = clock::now();
+  auto next_report = start + progress_period;
 
-    // auto t2 = std::chrono::system_clock::now();
-    // std::cerr << std::chrono::duration<double>(t2 - t1).count() << '\n';
-    if (compo_sharpe > best_sharpe) {
-      best_compo = compo;
-      best_sharpe = compo_sharpe;
+  auto lock = std::unique_lock(mutex);
+  while (!cv.wait_for(lock, std::chrono::milliseconds(100),
+                      [&done] { return done; })) {
+    auto now = clock::now();
+    if (interrupted || (time_budget && now - start >= *time_budget)) {
+      shared.stop = true;
     }
-  } while (permute_compo(compo, trucs.assets_capital.size(), nb_assets_perm));
+    if (now >= next_report) {
+      report_progress(shared, nb_compos, now - start);
+      next_report += progress_period;
+    }
+  }
+}
+
+template <unsigned K>
+static TopCompos
+max_compo_tree_multithread(const TrucsInteressants &trucs, unsigned nb_results,
+                           const TreeSlice &slice,
+                           std::optional<std::chrono::seconds> time_budget) {
+  auto order = assets_by_capital(trucs);
+  auto shared = TreeSearchShared();
+  set_rank_range<K>(shared, order.size(), slice);
+  auto pool = WorkStealingPool<TreeTask>();
+
+  // Number of compositions to explore, only to report the progress
+  auto nb_assets = order.size();
+  auto nb_compos =
+      shared.rank_range
+          ? double(shared.rank_range->last - shared.rank_range->first)
+          : std::exp(std::lgamma(nb_assets + 1.0) - std::lgamma(K + 1.0) -
+                     std::lgamma(nb_assets - K + 1.0));
+
+  // Each worker keeps its search state between the tasks
+  auto searches = std::vector<TreeSearch<K>>();
+  auto splitters = std::vector<TreeSplitter>();
+  searches.reserve(pool.nb_workers());
+  splitters.reserve(pool.nb_workers());
+  for (auto i = 0u; i < pool.nb_workers(); ++i) {
+    searches.emplace_back(trucs, order, shared, nb_results, i);
+    splitters.push_back(TreeSplitter{
+        [&pool]() { return pool.has_idle_workers(); },
+        [&pool, i](TreeTask &&task) { pool.push(i, std::move(task)); }});
+  }
+
+  std::clog << "Tree search of " << K << " assets on " << pool.nb_workers()
+            << " threads\n";
+
+  // A SIGINT stops the search instead of the process
+  interrupted = false;
+  auto previous_handler = std::signal(SIGINT, interrupt_handler);
+  auto mutex = std::mutex();
+  auto cv = std::condition_variable();
+  auto done = false;
+  auto monitor = std::thread(monitor_search, std::ref(shared), nb_compos,
+                             time_budget, std::ref(mutex), std::ref(cv),
+                             std::cref(done));
 
-  return std::make_tuple(best_compo, best_sharpe);
-}
\ No newline at end of file
+  auto tasks = std::vector<TreeTask>();
+  tasks.push_back(tree_root_task<K>(order));
+  pool.run(std::move(tasks), [&searches, &splitters](TreeTask &&task,
+                                                     unsigned i_worker) {
+    max_compo_tree2(searches[i_worker], task, splitters[i_worker]);
+  });
+
+  {
+    auto lock = std::lock_guard(mutex);
+    done = true;
+  }
+  cv.notify_one();
+  monitor.join();
+  std::signal(SIGINT, previous_handler);
+
+  std::clog << "Evaluated compositions: " << shared.nb_evaluated
+            << " | Pruned subtrees: " << shared.nb_pruned << '\n';
+  if (shared.stop) {
+    std::clog << "Search stopped before its end, keeping the best "
+                 "compositions found so far\n";
+  }
+
+  // The workers are done, their results can be merged without locks
+  auto results = TopCompos(nb_results);
+  for (const auto &search : searches) {
+    results.merge(search.results);
+  }
+  return results;
+}
+
+template <unsigned K>
+static finmath::PortfolioSums
+tree_leaf_sums(const TrucsInteressants &trucs,
+               const std::vector<share_index_t> &order,
+               std::span<const unsigned> positions) {
+  auto shared = TreeSearchShared();
+  auto search = TreeSearch<K>(trucs, order, shared, 1, 0);
+  search.depths[0].cross.assign(order.size(), 0);
+  set_first_position(search, positions[0]);
+  for (auto i = 0u; i + 1 < K; ++i) {
+    push_depth(search, search.depths[i], search.depths[i + 1], positions[i]);
+    search.positions[search.nb_positions++] = positions[i];
+  }
+  return leaf_sums(search, search.depths[K - 1], positions[K - 1]);
+}
+
+finmath::PortfolioSums tree_leaf_sums(const TrucsInteressants &trucs,
+                                      const std::vector<share_index_t> &order,
+                                      std::span<const unsigned> positions) {
+  return dispatch_portfolio_size(positions.size(), [&]<unsigned K>() {
+    return tree_leaf_sums<K>(trucs, order, positions);
+  });
+}
+
+TopCompos
+max_compo_tree_multithread(const TrucsInteressants &trucs,
+                           unsigned portfolio_size, unsigned nb_results,
+                           const TreeSlice &slice,
+                           std::optional<std::chrono::seconds> time_budget) {
+  return dispatch_portfolio_size(portfolio_size, [&]<unsigned K>() {
+    return max_compo_tree_multithread<K>(trucs, nb_results, slice,
+                                         time_budget);
+  });
+}
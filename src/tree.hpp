@@ -1,8 +1,23 @@
 #pragma once
 
+#include "combinadic.hpp"
+#include "composition.hpp"
 #include "save_data.hpp"
+#include "sharpe.hpp"
+#include "top_compos.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 using nb_shares_t = unsigned;
@@ -11,10 +26,10 @@ using compo_t = std::vector<std::tuple<nb_shares_t, share_index_t>>;
 using sharpe_t = double;
 
 // Min number of assets in portfolio
-constexpr unsigned min_portfolio_size = 40; // 15;
+constexpr unsigned min_portfolio_size = 15;
 
 // Max number of assets in portfolio
-constexpr unsigned max_portfolio_size = 40; // 40;
+constexpr unsigned max_portfolio_size = 40;
 
 // Min percent of the portfolio of a share
 constexpr double min_share_percent = 0.01;
@@ -25,6 +40,28 @@ constexpr double max_share_percent = 0.1;
 // Min percent of stock percent assets in portfolio
 constexpr double min_stock_percent = 0.5;
 
+/** Call `f.template operator()<K>()` with K equal to `portfolio_size`.
+ * The solvers are specialized for every portfolio size, this table selects
+ * the specialization from a size only known at runtime.
+ */
+template <typename F>
+decltype(auto) dispatch_portfolio_size(unsigned portfolio_size, F &&f) {
+  return [&]<unsigned... Is>(std::integer_sequence<unsigned, Is...>) {
+    using result_t = decltype(f.template operator()<min_portfolio_size>());
+    using specialization_t = result_t (*)(F &);
+
+    constexpr specialization_t table[] = {[](F &callback) -> result_t {
+      return callback.template operator()<min_portfolio_size + Is>();
+    }...};
+
+    if (portfolio_size < min_portfolio_size ||
+        portfolio_size > max_portfolio_size)
+      throw std::out_of_range("Unsupported portfolio size");
+    return table[portfolio_size - min_portfolio_size](f);
+  }(std::make_integer_sequence<unsigned, max_portfolio_size -
+                                             min_portfolio_size + 1>());
+}
+
 struct TrucsInteressants {
   finmath::assets_day_values_t start_values;
   finmath::assets_day_values_t end_values;
@@ -38,10 +75,198 @@ struct TrucsInteressants {
 /** Compute the portfolio capital at the start of the investment */
 double portolio_capital(const TrucsInteressants &trucs, const compo_t &compo);
 
-sharpe_t compute_sharpe(const TrucsInteressants &trucs, const compo_t &compo,
-                        finmath::asset_period_values_t &shares_capital);
+/** Compute the sharpe of the composition */
+sharpe_t compute_sharpe(const TrucsInteressants &trucs, const compo_t &compo);
+
+/** Try to create the best portfolio from a combination of assets */
+template <unsigned K>
+sharpe_t fill_compo(const TrucsInteressants &trucs,
+                    finmath::FixedComposition<K> &compo) {
+  // Find the asset with the min capital
+  double min_cap = INFINITY;
+  for (auto i_asset : compo.assets()) {
+    min_cap = std::min(min_cap, trucs.assets_capital[i_asset]);
+  }
+
+  // Fill the portfolio
+  auto max_cap = (max_share_percent / min_share_percent) * min_cap;
+  for (auto i = 0u; i < K; ++i) {
+    auto start_value = trucs.start_values[compo.assets()[i]];
+    compo.set_shares(i, (nb_shares_t)(max_cap / start_value), start_value);
+  }
+
+  return finmath::sharpe(
+      finmath::portfolio_sums(trucs.cov_matrix, trucs.end_values, compo));
+}
+
+/** Best sharpe found by any thread and the slot of the thread that found it,
+ * packed in a single atomic so that every thread updates it lock-free.
+ * The sharpe is kept as a float, it is only used to report the progress.
+ */
+class BestSharpeRecord {
+public:
+  /** Keep the sharpe if it is better than the recorded one */
+  void update(sharpe_t sharpe, unsigned slot);
+
+  /** The best sharpe and its slot, nothing if no sharpe was recorded */
+  std::optional<std::tuple<float, unsigned>> load() const;
+
+private:
+  /** Order preserving key of the sharpe in the high bits, slot in the low
+   * bits, 0 when empty */
+  std::atomic<std::uint64_t> packed_ = 0;
+};
+
+/** State shared between every thread of the tree search */
+struct TreeSearchShared {
+  /** Max of the results thresholds of every thread: a composition must beat
+   * it to be among the best ones, so it is used to prune the subtrees */
+  std::atomic<sharpe_t> min_sharpe = -INFINITY;
+
+  /** Number of complete compositions evaluated */
+  std::atomic<unsigned long long> nb_evaluated = 0;
+
+  /** Number of partial compositions whose subtree has been pruned */
+  std::atomic<unsigned long long> nb_pruned = 0;
+
+  /** Number of complete compositions in the pruned subtrees */
+  std::atomic<double> nb_pruned_compos = 0;
+
+  /** Best sharpe found so far, to report the progress */
+  BestSharpeRecord best;
+
+  /** Set to stop every thread, which keep the results found so far */
+  std::atomic<bool> stop = false;
+
+  /** Only the compositions whose rank is in this range are explored, every
+   * composition if empty */
+  std::optional<RankRange> rank_range;
+  std::optional<Binomials> binomials;
+};
+
+/** Part of the compositions explored by the tree search, so that several
+ * processes can each explore a disjoint part */
+struct TreeSlice {
+  /** Explore the `shard_index`-th of `nb_shards` slices of the ranks */
+  unsigned shard_index = 0;
+  unsigned nb_shards = 1;
+
+  /** Explore the compositions of these ranks, replaces the shard */
+  std::optional<RankRange> rank_range;
+};
+
+/** Get the assets indices sorted by increasing capital.
+ * The tree search enumerates the combinations of positions in this order so
+ * that the first asset of a composition is the one with the min capital,
+ * which fixes the number of shares of every other asset.
+ */
+std::vector<share_index_t> assets_by_capital(const TrucsInteressants &trucs);
+
+/** A part of the tree search: the compositions starting with the positions
+ * of `prefix`, followed by a position in [first, last) */
+struct TreeTask {
+  std::vector<unsigned> prefix;
+  unsigned first = 0;
+  unsigned last = 0;
+};
+
+/** Callbacks used by the tree search to give away part of its work */
+struct TreeSplitter {
+  /** Whether the current task should be split */
+  std::function<bool()> should_split;
+
+  /** Give a part of the current task to the other workers */
+  std::function<void(TreeTask &&)> give;
+};
+
+/** Partial sums of the first assets of the composition */
+struct TreeDepth {
+  finmath::PortfolioSums sums;
+
+  /** Sum of `b_i * cov[i][q]` over the assets i for every position q */
+  std::vector<double> cross;
+};
+
+/** State of the tree search of one worker, reused between its tasks.
+ * Specialized on the portfolio size K so that the partial compositions are
+ * stored in fixed arrays.
+ */
+template <unsigned K> struct TreeSearch {
+  const TrucsInteressants &trucs;
+  const std::vector<share_index_t> &order;
+  TreeSearchShared &shared;
+  const TreeSplitter *splitter = nullptr;
+
+  /** Index of the worker, recorded with its best sharpe */
+  unsigned slot;
+
+  /** Position of the first asset of the compositions currently explored */
+  unsigned first_pos = -1;
+
+  /** Values of each position of `order` once filled by `fill_compo` */
+  std::vector<double> buy_values;
+  std::vector<double> sell_values;
+  std::vector<double> gains;
+
+  /** Min covariance term `b_q * b_l * cov[q][l]` of each position with any
+   * other candidate position */
+  std::vector<double> min_cross;
+
+  /** Positions of the current partial composition */
+  std::array<unsigned, K> positions;
+  unsigned nb_positions = 0;
+
+  /** Partial sums for each size of the partial composition */
+  std::array<TreeDepth, K + 1> depths;
+
+  /** Rank of the first composition of the subtree of the partial composition
+   * for each of its sizes, only when a rank range is explored */
+  std::array<rank_t, K + 1> ranks{};
+
+  /** `log(n!)` for every n up to the number of assets */
+  std::vector<double> log_factorials;
+
+  finmath::FixedComposition<K> compo;
+  std::vector<double> scratch;
+
+  /** Best compositions found by this worker */
+  TopCompos results;
+
+  unsigned long long nb_evaluated = 0;
+  unsigned long long nb_pruned = 0;
+  double nb_pruned_compos = 0;
+
+  TreeSearch(const TrucsInteressants &trucs_,
+             const std::vector<share_index_t> &order_,
+             TreeSearchShared &shared_, unsigned nb_results, unsigned slot_)
+      : trucs(trucs_), order(order_), shared(shared_), slot(slot_),
+        results(nb_results) {}
+
+  /** Sharpe a composition must beat to be among the best ones */
+  sharpe_t incumbent() const {
+    return std::max(results.threshold(),
+                    shared.min_sharpe.load(std::memory_order_relaxed));
+  }
+};
+
+/** Sums of the composition of the increasing `positions` in the `order` of
+ * `assets_by_capital`, built from the partial sums like the tree search, to
+ * check them against the reference */
+finmath::PortfolioSums tree_leaf_sums(const TrucsInteressants &trucs,
+                                      const std::vector<share_index_t> &order,
+                                      std::span<const unsigned> positions);
 
-std::tuple<compo_t, sharpe_t>
-max_compo_tree2(const TrucsInteressants &trucs,
-                finmath::asset_period_values_t &shares_capital, compo_t &compo,
-                share_index_t start_asset = 0);
\ No newline at end of file
+/** Find the `nb_results` best compositions of `portfolio_size` assets of the
+ * slice with a tree search on every thread.
+ * Use a branch-and-bound search: the subtrees whose sharpe upper bound cannot
+ * beat the `nb_results`-th best sharpe found by any thread are not explored.
+ * The ranks of the slice are the ones of the lexicographic order of the
+ * positions in `assets_by_capital`.
+ *
+ * The progress is reported periodically. After `time_budget` or on SIGINT,
+ * the search stops and returns the best compositions found so far.
+ */
+TopCompos max_compo_tree_multithread(
+    const TrucsInteressants &trucs, unsigned portfolio_size,
+    unsigned nb_results, const TreeSlice &slice,
+    std::optional<std::chrono::seconds> time_budget = std::nullopt);
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Thread pool where each worker has its own queue of tasks, and steals the
+ * oldest tasks of the other workers when its own queue is empty.
+ *
+ * The tasks can push new tasks (e.g. the second half of their work) while
+ * running, `has_idle_workers` tells when it is worth doing so.
+ */
+template <class Task> class WorkStealingPool {
+public:
+  /** Function running a task on the worker `i_worker` */
+  using TaskRunner = std::function<void(Task &&task, unsigned i_worker)>;
+
+  /** Create a pool of `nb_workers`, or one worker per hardware thread */
+  explicit WorkStealingPool(unsigned nb_workers = 0)
+      : queues_(nb_workers ? nb_workers : default_nb_workers()) {}
+
+  unsigned nb_workers() const { return queues_.size(); }
+
+  /** Whether a worker is waiting for a task and there is no queued task it
+   * could take */
+  bool has_idle_workers() const {
+    return nb_idle_.load(std::memory_order_relaxed) >
+           nb_queued_.load(std::memory_order_relaxed);
+  }
+
+  /** Add a task to the queue of the worker `i_worker` */
+  void push(unsigned i_worker, Task &&task) {
+    nb_pending_.fetch_add(1, std::memory_order_relaxed);
+    nb_queued_.fetch_add(1, std::memory_order_relaxed);
+    {
+      auto lock = std::lock_guard(queues_[i_worker].mutex);
+      queues_[i_worker].tasks.push_back(std::move(task));
+    }
+    idle_cv_.notify_one();
+  }
+
+  /** Run the given tasks and the ones they push, and only return when
+   * every task has been run */
+  void run(std::vector<Task> &&tasks, const TaskRunner &runner) {
+    for (auto i = 0u; i < tasks.size(); ++i) {
+      push(i % nb_workers(), std::move(tasks[i]));
+    }
+
+    auto threads = std::vector<std::thread>();
+    threads.reserve(nb_workers());
+    for (auto i = 0u; i < nb_workers(); ++i) {
+      threads.emplace_back([this, &runner, i]() { work(runner, i); });
+    }
+
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+private:
+  static unsigned default_nb_workers() {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  /** Take the newest task of the worker own queue, or the oldest task of
+   * another worker */
+  bool take(unsigned i_worker, Task &task) {
+    {
+      auto &queue = queues_[i_worker];
+      auto lock = std::lock_guard(queue.mutex);
+      if (!queue.tasks.empty()) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        nb_queued_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    for (auto i = 1u; i < nb_workers(); ++i) {
+      auto &queue = queues_[(i_worker + i) % nb_workers()];
+      auto lock = std::lock_guard(queue.mutex);
+      if (!queue.tasks.empty()) {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        nb_queued_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void work(const TaskRunner &runner, unsigned i_worker) {
+    auto task = Task();
+    while (true) {
+      if (take(i_worker, task)) {
+        runner(std::move(task), i_worker);
+
+        // The last task is done, wake up the idle workers so they can stop
+        if (nb_pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          idle_cv_.notify_all();
+        }
+        continue;
+      }
+
+      if (nb_pending_.load(std::memory_order_acquire) == 0)
+        return;
+
+      // Wait for a worker to push a task
+      nb_idle_.fetch_add(1, std::memory_order_relaxed);
+      {
+        auto lock = std::unique_lock(idle_mutex_);
+        idle_cv_.wait_for(lock, std::chrono::milliseconds(1));
+      }
+      nb_idle_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  std::vector<Queue> queues_;
+
+  /** Number of tasks pushed and not yet completed */
+  std::atomic<unsigned long long> nb_pending_ = 0;
+
+  /** Number of tasks waiting in the queues */
+  std::atomic<unsigned> nb_queued_ = 0;
+
+  /** Number of workers waiting for a task */
+  std::atomic<unsigned> nb_idle_ = 0;
+
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+};